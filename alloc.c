@@ -0,0 +1,93 @@
+/**
+ *  Copyright 2013 by Benjamin J. Land (a.k.a. BenLand100)
+ *
+ *  This file is part of L, a virtual machine for a lisp-like language.
+ *
+ *  L is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  L is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with L. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "alloc.h"
+#include "lisp.h"
+
+POOL alloc_pools[ALLOC_TYPES];
+
+//sorted table of every slab, so conservative roots can be validated
+static SLAB **slab_table = NIL;
+static size_t slab_table_cap = 0;
+size_t alloc_slabs = 0;
+
+//set once the heap reaches alloc_trigger slabs; the collector polls it
+size_t alloc_trigger = 0;
+int alloc_pressure = 0;
+
+static void slab_register(SLAB *slab) {
+    if (alloc_slabs == slab_table_cap) {
+        slab_table_cap = slab_table_cap ? slab_table_cap*2 : 64;
+        slab_table = (SLAB**)realloc(slab_table,slab_table_cap*sizeof(SLAB*));
+        failNIL(slab_table,"Out of memory");
+    }
+    size_t i = alloc_slabs++;
+    while (i > 0 && slab_table[i-1] > slab) {
+        slab_table[i] = slab_table[i-1];
+        i--;
+    }
+    slab_table[i] = slab;
+}
+
+//returns the slab containing ptr or NIL if ptr is not slab memory
+SLAB* alloc_slab(void *ptr) {
+    SLAB *slab = slab_of(ptr);
+    size_t lo = 0, hi = alloc_slabs;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (slab_table[mid] == slab) return slab;
+        if (slab_table[mid] < slab) lo = mid + 1; else hi = mid;
+    }
+    return NIL;
+}
+
+//carves a fresh slab into cells, threads all but the first onto the free list
+void* alloc_refill(POOL *pool, size_t size) {
+    if (!pool->size) pool->size = alloc_class(size);
+    size_t cells = (ALLOC_SLAB - alloc_class(sizeof(SLAB))) / pool->size;
+    SLAB *slab;
+    if (posix_memalign((void**)&slab,ALLOC_SLAB,ALLOC_SLAB)) error("Out of memory");
+    slab->cells = cells;
+    slab->size = pool->size;
+    memset(slab->marks,0,sizeof(slab->marks));
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    slab_register(slab);
+    if (alloc_trigger && alloc_slabs >= alloc_trigger) alloc_pressure = 1;
+    char *base = slab_cells(slab);
+    for (size_t i = cells-1; i > 0; i--) {
+        CELL *cell = (CELL*)(base + i*pool->size);
+        cell->type = ID_FREE;
+        cell->next = pool->free;
+        pool->free = cell;
+    }
+    return base;
+}
+
+size_t alloc_live() {
+    size_t live = 0;
+    for (int i = 0; i < ALLOC_TYPES; i++) live += alloc_pools[i].live;
+    return live;
+}
+
+size_t alloc_total() {
+    size_t total = 0;
+    for (int i = 0; i < ALLOC_TYPES; i++) total += alloc_pools[i].total;
+    return total;
+}
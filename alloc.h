@@ -0,0 +1,105 @@
+/**
+ *  Copyright 2013 by Benjamin J. Land (a.k.a. BenLand100)
+ *
+ *  This file is part of L, a virtual machine for a lisp-like language.
+ *
+ *  L is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  L is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with L. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ALLOC
+#define _ALLOC
+
+#include <stdlib.h>
+#include <stdint.h>
+
+//slab allocator for VALUE objects: one pool (free list + slabs) per type id,
+//each pool carving its slabs into cells of that type's size class.
+//compile with -DNO_SLAB to fall back to plain malloc/free.
+//compile with -DLAZY_FREE to release dead objects' children a few at a time
+//on later allocations instead of all at once when the object dies.
+
+#define ALLOC_TYPES     16
+#define ALLOC_SLAB      (64*1024)
+#define ID_FREE         0xFF
+#define LAZY_FREE_BUDGET 8
+
+//a dead cell; overlays the type and refc fields of the VALUE header
+typedef struct CELL {
+    unsigned char type;
+    struct CELL *next;
+} CELL;
+
+//slabs are ALLOC_SLAB aligned so any cell maps back to its slab by masking
+typedef struct SLAB {
+    struct SLAB *next;
+    size_t cells,size;
+    unsigned char marks[ALLOC_SLAB/16/8];
+} SLAB;
+
+typedef struct {
+    CELL *free;
+    SLAB *slabs;
+    size_t size;
+    size_t live,total;
+} POOL;
+
+extern POOL alloc_pools[ALLOC_TYPES];
+extern size_t alloc_slabs, alloc_trigger;
+extern int alloc_pressure;
+
+void* alloc_refill(POOL *pool, size_t size);
+SLAB* alloc_slab(void *ptr);
+size_t alloc_live();
+size_t alloc_total();
+
+//dead objects whose children are not yet released; see freeVALUE
+extern void *free_dead;
+void freeDeferred(size_t budget);
+
+#define alloc_class(size) (((size) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
+#define slab_cells(slab) ((char*)(slab) + alloc_class(sizeof(SLAB)))
+#define slab_of(ptr) ((SLAB*)(((uintptr_t)(ptr)) & ~((uintptr_t)ALLOC_SLAB - 1)))
+#define slab_index(slab,ptr) ((size_t)((char*)(ptr) - slab_cells(slab)) / (slab)->size)
+
+static inline void* alloc_VALUE(unsigned char type, size_t size) {
+#ifdef LAZY_FREE
+    if (free_dead) freeDeferred(LAZY_FREE_BUDGET);
+#endif
+    POOL *pool = &alloc_pools[type];
+    pool->live++;
+    pool->total++;
+#ifdef NO_SLAB
+    return malloc(size);
+#else
+    CELL *cell = pool->free;
+    if (!cell) return alloc_refill(pool,size);
+    pool->free = cell->next;
+    return cell;
+#endif
+}
+
+static inline void free_VALUE(void *val, unsigned char type) {
+    POOL *pool = &alloc_pools[type];
+    pool->live--;
+#ifdef NO_SLAB
+    free(val);
+#else
+    CELL *cell = (CELL*)val;
+    cell->type = ID_FREE;
+    cell->next = pool->free;
+    pool->free = cell;
+#endif
+}
+
+#endif
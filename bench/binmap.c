@@ -0,0 +1,84 @@
+/**
+ *  Copyright 2013 by Benjamin J. Land (a.k.a. BenLand100)
+ *
+ *  This file is part of L, a virtual machine for a lisp-like language.
+ *
+ *  L is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  L is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with L. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//worst-case lookup depth and lookup time of binmap for key orders that
+//degenerate an unbalanced BST: ascending integers and ascending symbol ids
+
+#include <time.h>
+#include "binmap.h"
+#include "parser.h"
+
+//the pre-treap insert, for comparison
+static NODE* naive_put(VALUE *key, NODE *map) {
+    for (;;) {
+        NODE *tree = (NODE*)map->addr;
+        VALUE **slot = cmpVALUE(key,((NODE*)map->data)->data) > 0 ? &tree->addr : &tree->data;
+        if (!*slot) {
+            *slot = (VALUE*)binmap(key,NIL);
+            return map;
+        }
+        map = (NODE*)*slot;
+    }
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static VALUE* key(int kind, int i) {
+    if (kind == 0) return (VALUE*)newINTEGER(i);
+    char name[32];
+    sprintf(name,"BENCH-%d",i);
+    return (VALUE*)newSYMBOL(intern(name));
+}
+
+int main() {
+    const char *kinds[2] = { "integer", "symbol" };
+    printf("%-8s %8s %8s %8s %12s\n","keys","n","treap","naive","ns/lookup");
+    for (int kind = 0; kind < 2; kind++) {
+        for (int n = 1000; n <= 100000; n *= 10) {
+            NODE *map = binmap(key(kind,0),NIL);
+            for (int i = 1; i < n; i++) binmap_put(key(kind,i),NIL,map);
+            size_t naive_depth = 0;
+            if (n <= 10000) {
+                NODE *naive = binmap(key(kind,0),NIL);
+                for (int i = 1; i < n; i++) naive_put(key(kind,i),naive);
+                naive_depth = binmap_depth(naive);
+                decRef(naive);
+            }
+            VALUE **keys = (VALUE**)malloc(n*sizeof(VALUE*));
+            for (int i = 0; i < n; i++) keys[i] = key(kind,i);
+            int rounds = 10000000 / n;
+            double start = now();
+            for (int r = 0; r < rounds; r++) {
+                for (int i = 0; i < n; i++) decRef(binmap_find(keys[i],map));
+            }
+            double ns = (now() - start) * 1e9 / ((double)rounds * n);
+            for (int i = 0; i < n; i++) decRef(keys[i]);
+            free(keys);
+            char naive_str[16] = "-";
+            if (naive_depth) sprintf(naive_str,"%u",(unsigned int)naive_depth);
+            printf("%-8s %8d %8u %8s %12.1f\n",kinds[kind],n,(unsigned int)binmap_depth(map),naive_str,ns);
+            decRef(map);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,8 @@
+#!/bin/bash
+#builds each bench/*.c against the interpreter sources (all but test.c's main)
+
+cd "$(dirname "$0")"
+SRC=$(ls ../*.c | grep -v '/test\.c$')
+for bench in *.c; do
+    gcc -std=gnu99 -pedantic -Wall -O2 "$@" -I.. $SRC "$bench" -o "${bench%.c}" || exit 1
+done
@@ -0,0 +1,28 @@
+#!/bin/bash
+#builds the interpreter with each set of flags a check needs and compares what
+#the check prints on every engine with its .out file: bench/numeric.l with each
+#representation of numbers, bench/gc.l with the tracing collector
+
+cd "$(dirname "$0")/.."
+SRC=$(ls *.c)
+fail=0
+
+#check file.l flags...
+check() {
+    local file=$1 out=${1%.l}.out
+    shift
+    for flags in "$@"; do
+        gcc -std=gnu99 -O2 $flags $SRC -o bench/lisp-check || exit 1
+        for engine in --tree --vm --stack; do
+            if ! bench/lisp-check $engine lang.l $file | tail -n $(wc -l < $out) | diff - $out; then
+                echo "$file: wrong results with '$flags' $engine"
+                fail=1
+            fi
+        done
+    done
+}
+
+check bench/numeric.l "" "-DNAN_BOXING"
+check bench/gc.l "-DTRACING_GC" "-DTRACING_GC -DNO_REFC"
+rm -f bench/lisp-check
+exit $fail
@@ -22,6 +22,11 @@
 //entry = (key . val)
 //tree = (left . right)
 //node = (entry . tree)
+//
+//a treap: ordered by key, heap-ordered by a priority hashed from the key, so
+//the shape is that of a random BST whatever the insertion order. the root
+//never changes identity (callers hold it), so a new entry that outranks the
+//root moves the old root's contents into a fresh node beneath it.
 
 #define binmap_entry(binmap) ((NODE*)(binmap)->data)
 #define binmap_key(binmap) binmap_entry(binmap)->data
@@ -30,47 +35,166 @@
 #define binmap_left(binmap) ((NODE*)binmap_tree(binmap)->data)
 #define binmap_right(binmap) ((NODE*)binmap_tree(binmap)->addr)
 
+static inline unsigned int binmap_mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return (unsigned int)x;
+}
+
+//equal keys must hash equal, so this follows cmpVALUE
+static unsigned int binmap_priority(VALUE *key) {
+    if (!key) return 0;
+    switch (typeOf(key)) {
+        case ID_SYMBOL:
+            return binmap_mix(((SYMBOL*)key)->sym);
+        case ID_INTEGER:
+            return binmap_mix((uint64_t)asINTEGER(key));
+        case ID_REAL: {
+            T_REAL real = asREAL(key);
+            uint64_t bits = 0;
+            memcpy(&bits,&real,sizeof(real) < sizeof(bits) ? sizeof(real) : sizeof(bits));
+            return binmap_mix(bits);
+        }
+        case ID_STRING: {
+            unsigned int hval = 2166136261u;
+            for (const char *c = ((STRING*)key)->str; *c; c++) hval = (hval ^ (unsigned char)*c) * 16777619u;
+            return binmap_mix(hval);
+        }
+        case ID_PRIMFUNC:
+            return binmap_mix((uintptr_t)((PRIMFUNC*)key)->native);
+        case ID_LOCAL:
+            return binmap_mix(((LOCAL*)key)->sym);
+    }
+    return binmap_mix((uintptr_t)key);
+}
+
+//symbol keys skip the cmpVALUE switch
+static inline int binmap_cmp(VALUE *key, VALUE *other) {
+    if (key && other && !isIMMEDIATE(key) && !isIMMEDIATE(other) && key->type == ID_SYMBOL && other->type == ID_SYMBOL) {
+        T_SYMBOL a = ((SYMBOL*)key)->sym, b = ((SYMBOL*)other)->sym;
+        return (a > b) - (a < b);
+    }
+    return cmpVALUE(key,other);
+}
+
 NODE* binmap(void *key, void *val) {
     return newNODE(newNODE(key,val),newNODE(NIL,NIL));
 }
 
-NODE* binmap_find(void *key, NODE *_binmap) {
-    //debugVal(_binmap,"find: ");
-    if (!_binmap) return NIL;
-    int cmp = cmpVALUE(asVALUE(key),binmap_key(_binmap));
-    if (!cmp) {
-        NODE *entry = binmap_entry(_binmap);
-        incRef(entry);
-        return entry;
-    } else if (cmp > 0) {
-        return binmap_find(key,binmap_right(_binmap));
-    } else {
-        return binmap_find(key,binmap_left(_binmap));
+NODE* binmap_find(void *_key, NODE *_binmap) {
+    VALUE *key = asVALUE(_key);
+    while (_binmap) {
+        int cmp = binmap_cmp(key,binmap_key(_binmap));
+        if (!cmp) {
+            NODE *entry = binmap_entry(_binmap);
+            incRef(entry);
+            return entry;
+        }
+        _binmap = cmp > 0 ? binmap_right(_binmap) : binmap_left(_binmap);
     }
+    return NIL;
 }
 
-void binmap_put(void *key, void *val, NODE *_binmap) {
-    failNIL(_binmap,"BINMAP is NIL");
-    int cmp = cmpVALUE(asVALUE(key),binmap_key(_binmap));
-    if (!cmp) {
-        decRef((VALUE*)key);
-        decRef(binmap_val(_binmap));
-        binmap_val(_binmap) = asVALUE(val);
-    } else if (cmp > 0) {
-        if (binmap_right(_binmap)) { 
-            binmap_put(key,val,binmap_right(_binmap));
+//splits the subtree t (whose reference the caller hands over) around key into
+//*left and *right; moves references only, so no counts change
+static void binmap_split(VALUE *key, NODE *t, VALUE **left, VALUE **right) {
+    while (t) {
+        if (binmap_cmp(key,binmap_key(t)) > 0) {
+            *left = (VALUE*)t;
+            left = &binmap_tree(t)->addr;
+            t = binmap_right(t);
         } else {
-            decRef(binmap_tree(_binmap)->addr);
-            binmap_tree(_binmap)->addr = asVALUE(binmap(key,val));
+            *right = (VALUE*)t;
+            right = &binmap_tree(t)->data;
+            t = binmap_left(t);
         }
-    } else {
-        if (binmap_left(_binmap)) {
-            binmap_put(key,val,binmap_left(_binmap));
-        } else {
-            decRef(binmap_tree(_binmap)->data);
-            binmap_tree(_binmap)->data = asVALUE(binmap(key,val));
+    }
+    *left = NIL;
+    *right = NIL;
+}
+
+//returns the (borrowed) entry now holding key
+NODE* binmap_put(void *_key, void *val, NODE *_binmap) {
+    failNIL(_binmap,"BINMAP is NIL");
+    VALUE *key = asVALUE(_key);
+    for (NODE *node = _binmap; node; ) {
+        int cmp = binmap_cmp(key,binmap_key(node));
+        if (!cmp) {
+            decRef(key);
+            decRef(binmap_val(node));
+            binmap_val(node) = asVALUE(val);
+            return binmap_entry(node);
+        }
+        node = cmp > 0 ? binmap_right(node) : binmap_left(node);
+    }
+    unsigned int prio = binmap_priority(key);
+    NODE *entry = newNODE(key,val);
+    if (prio > binmap_priority(binmap_key(_binmap))) {
+        NODE *old = newNODE(_binmap->data,_binmap->addr);
+        _binmap->data = (VALUE*)entry;
+        _binmap->addr = (VALUE*)newNODE(NIL,NIL);
+        binmap_split(key,old,&binmap_tree(_binmap)->data,&binmap_tree(_binmap)->addr);
+        return entry;
+    }
+    //descend to where the new node outranks the subtree, then split that subtree beneath it
+    NODE *parent = _binmap;
+    for (;;) {
+        VALUE **slot = binmap_cmp(key,binmap_key(parent)) > 0 ? &binmap_tree(parent)->addr : &binmap_tree(parent)->data;
+        NODE *child = (NODE*)*slot;
+        if (!child || prio > binmap_priority(binmap_key(child))) {
+            NODE *node = newNODE((VALUE*)entry,(VALUE*)newNODE(NIL,NIL));
+            *slot = (VALUE*)node;
+            binmap_split(key,child,&binmap_tree(node)->data,&binmap_tree(node)->addr);
+            return entry;
         }
+        parent = child;
     }
-}  
+}
 
+//in-order walk over the entries, without recursion
+void binmap_each(NODE *_binmap, void (*fn)(NODE *entry, void *arg), void *arg) {
+    size_t len = 0, cap = 64;
+    NODE **path = (NODE**)malloc(cap*sizeof(NODE*));
+    failNIL(path,"Out of memory");
+    while (_binmap || len) {
+        for (; _binmap; _binmap = binmap_left(_binmap)) {
+            if (len == cap) {
+                path = (NODE**)realloc(path,(cap *= 2)*sizeof(NODE*));
+                failNIL(path,"Out of memory");
+            }
+            path[len++] = _binmap;
+        }
+        _binmap = path[--len];
+        fn(binmap_entry(_binmap),arg);
+        _binmap = binmap_right(_binmap);
+    }
+    free(path);
+}
 
+//number of nodes on the longest root-to-leaf path, the worst case for a lookup
+size_t binmap_depth(NODE *_binmap) {
+    typedef struct { NODE *node; size_t depth; } DEPTH;
+    if (!_binmap) return 0;
+    size_t len = 1, cap = 64, deepest = 0;
+    DEPTH *todo = (DEPTH*)malloc(cap*sizeof(DEPTH));
+    failNIL(todo,"Out of memory");
+    todo[0] = (DEPTH){ _binmap, 1 };
+    while (len) {
+        DEPTH cur = todo[--len];
+        if (cur.depth > deepest) deepest = cur.depth;
+        NODE *kids[2] = { binmap_left(cur.node), binmap_right(cur.node) };
+        for (int i = 0; i < 2; i++) {
+            if (!kids[i]) continue;
+            if (len == cap) {
+                todo = (DEPTH*)realloc(todo,(cap *= 2)*sizeof(DEPTH));
+                failNIL(todo,"Out of memory");
+            }
+            todo[len++] = (DEPTH){ kids[i], cur.depth + 1 };
+        }
+    }
+    free(todo);
+    return deepest;
+}
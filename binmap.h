@@ -26,6 +26,8 @@
 
 NODE* binmap(void *key, void *val);
 NODE* binmap_find(void *key, NODE *binmap);
-void binmap_put(void *key, void *val, NODE *binmap);
+NODE* binmap_put(void *key, void *val, NODE *binmap);
+void binmap_each(NODE *binmap, void (*fn)(NODE *entry, void *arg), void *arg);
+size_t binmap_depth(NODE *binmap);
 
 #endif
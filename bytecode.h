@@ -0,0 +1,64 @@
+/**
+ *  Copyright 2013 by Benjamin J. Land (a.k.a. BenLand100)
+ *
+ *  This file is part of L, a virtual machine for a lisp-like language.
+ *
+ *  L is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  L is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with L. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BYTECODE
+#define _BYTECODE
+
+#include "lisp.h"
+
+//a stack machine for macroexpanded, resolved forms. compile() turns a form into
+//a CODE value; evaluating a CODE runs vm_run in the current scope, so compiled
+//and tree-walked code call each other freely. a compiled LAMBDA creates the same
+//(scope . (vars . body)) closure as l_lambda, with the body a single CODE.
+//
+//each op is an int followed by its int operands; k indexes CODE->consts and
+//jumps are relative to the end of the op
+
+#define OP_NIL          0  //                 push NIL
+#define OP_CONST        1  // k               push consts[k]
+#define OP_GLOBAL       2  // k               push the binding of symbol consts[k]
+#define OP_LOCAL        3  // depth slot      push a frame slot
+#define OP_POP          4  //                 drop the top value
+#define OP_JUMP         5  // off
+#define OP_JUMPNIL      6  // off             pop, jump if it was NIL
+#define OP_CLOSURE      7  // k               push a closure over (vars . body) consts[k]
+#define OP_ARGS         8  // k off           if the callee on top takes its arguments
+                           //                 unevaluated, call it on the form list
+                           //                 consts[k] and jump past the OP_CALL
+#define OP_CALL         9  // n               call the value under n arguments
+#define OP_CALLPRIM     10 // k n             call the SPEC_FUNC consts[k] on n arguments
+#define OP_LIST         11 // n               collect n values into a list
+#define OP_EVAL         12 // k               evaluate consts[k] with the tree walker
+#define OP_RETURN       13
+#define OP_TAILCALL     14 // n               OP_CALL in tail position: a compiled
+                           //                 closure replaces the running code
+#define OP_ENTER        15 // k               push a frame for the ARGSPEC consts[k]
+#define OP_LEAVE        16 //                 pop the frame OP_ENTER pushed
+#define OP_DOTIMES      17 // off             with count and index on top: pop both and
+                           //                 jump once index reaches count, else store
+                           //                 index in slot 0 and increment it
+#define OP_DOLIST       18 // off             with a list on top: pop it and jump if
+                           //                 empty, else store its head in slot 0 and
+                           //                 replace it with its tail
+
+VALUE* compile(VALUE *form);
+void compile_body(NODE *lambda);
+VALUE* vm_run(CODE *code, NODE *scope);
+
+#endif
@@ -0,0 +1,310 @@
+/**
+ *  Copyright 2013 by Benjamin J. Land (a.k.a. BenLand100)
+ *
+ *  This file is part of L, a virtual machine for a lisp-like language.
+ *
+ *  L is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  L is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with L. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bytecode.h"
+#include "primitives.h"
+#include "listops.h"
+#include "scope.h"
+
+typedef struct {
+    int *ops;
+    size_t len, cap;
+    VALUE **consts;
+    size_t nconsts, ccap;
+    size_t depth, max;
+} COMPILER;
+
+static void compile_expr(COMPILER *c, VALUE *val, bool tail);
+
+static void emit(COMPILER *c, int op) {
+    if (c->len == c->cap) {
+        c->cap = c->cap ? c->cap*2 : 32;
+        c->ops = (int*)realloc(c->ops,c->cap*sizeof(int));
+        failNIL(c->ops,"Out of memory");
+    }
+    c->ops[c->len++] = op;
+}
+
+//tracks how deep the VM stack gets
+static void stack(COMPILER *c, int delta) {
+    c->depth += delta;
+    if (c->depth > c->max) c->max = c->depth;
+}
+
+//takes a new reference to val
+static int constant(COMPILER *c, VALUE *val) {
+    for (size_t i = 0; i < c->nconsts; i++) {
+        if (c->consts[i] == val) return i;
+    }
+    if (c->nconsts == c->ccap) {
+        c->ccap = c->ccap ? c->ccap*2 : 8;
+        c->consts = (VALUE**)realloc(c->consts,c->ccap*sizeof(VALUE*));
+        failNIL(c->consts,"Out of memory");
+    }
+    incRef(val);
+    c->consts[c->nconsts] = val;
+    return c->nconsts++;
+}
+
+//emits a jump and returns where its offset goes
+static size_t jump(COMPILER *c, int op) {
+    emit(c,op);
+    emit(c,0);
+    return c->len;
+}
+
+static void patch(COMPILER *c, size_t at) {
+    c->ops[at-1] = c->len - at;
+}
+
+static void compile_push(COMPILER *c, int op, VALUE *val) {
+    emit(c,op);
+    emit(c,constant(c,val));
+    stack(c,1);
+}
+
+//each form's value is dropped but the last, which is in tail position if the prog is
+static void compile_prog(COMPILER *c, NODE *forms, bool tail) {
+    if (!forms) {
+        emit(c,OP_NIL);
+        stack(c,1);
+    }
+    for (; forms; forms = asNODE(forms->addr)) {
+        compile_expr(c,forms->data,tail && !forms->addr);
+        if (forms->addr) {
+            emit(c,OP_POP);
+            stack(c,-1);
+        }
+    }
+}
+
+//pushes each argument, returns how many
+static int compile_args(COMPILER *c, NODE *args) {
+    int n = 0;
+    for (; args; args = asNODE(args->addr), n++) compile_expr(c,args->data,false);
+    return n;
+}
+
+static void compile_cond(COMPILER *c, NODE *clauses, bool tail) {
+    size_t ends[list_length(clauses)+1], nends = 0;
+    for (; clauses; clauses = asNODE(clauses->addr)) {
+        NODE *test = asNODE(clauses->data);
+        if (list_length(test) != 2) error("Malformed conditional");
+        compile_expr(c,test->data,false);
+        size_t next = jump(c,OP_JUMPNIL);
+        stack(c,-1);
+        compile_expr(c,asNODE(test->addr)->data,tail);
+        ends[nends++] = jump(c,OP_JUMP);
+        stack(c,-1);
+        patch(c,next);
+    }
+    emit(c,OP_NIL);
+    stack(c,1);
+    while (nends) patch(c,ends[--nends]);
+}
+
+//each form is run for effect
+static void compile_effect(COMPILER *c, NODE *forms) {
+    for (; forms; forms = asNODE(forms->addr)) {
+        compile_expr(c,forms->data,false);
+        emit(c,OP_POP);
+        stack(c,-1);
+    }
+}
+
+//jumps back to top, which is an offset into the ops
+static void compile_back(COMPILER *c, size_t top) {
+    emit(c,OP_JUMP);
+    emit(c,0);
+    c->ops[c->len-1] = (int)top - (int)c->len;
+}
+
+static void compile_while(COMPILER *c, NODE *args) {
+    if (!args) error("WHILE takes at least 1 argument");
+    size_t top = c->len;
+    compile_expr(c,args->data,false);
+    size_t exit = jump(c,OP_JUMPNIL);
+    stack(c,-1);
+    compile_effect(c,asNODE(args->addr));
+    compile_back(c,top);
+    patch(c,exit);
+    emit(c,OP_NIL);
+    stack(c,1);
+}
+
+//DOTIMES keeps its count and index on the stack, DOLIST the rest of its list,
+//while the body runs in the loop's frame
+static void compile_loop(COMPILER *c, NODE *args, int op) {
+    NODE *header = asNODE(args ? args->data : NIL);
+    if (list_length(header) != 2) error("Malformed loop header");
+    compile_expr(c,asNODE(header->addr)->data,false);
+    emit(c,OP_ENTER);
+    emit(c,constant(c,(VALUE*)scope_loopArgs(header)));
+    int state = 1;
+    if (op == OP_DOTIMES) {
+        VALUE *zero = newINTEGER(0);
+        compile_push(c,OP_CONST,zero);
+        decRef(zero);
+        state++;
+    }
+    size_t top = c->len;
+    size_t exit = jump(c,op);
+    compile_effect(c,asNODE(args->addr));
+    compile_back(c,top);
+    patch(c,exit);
+    stack(c,-state);
+    emit(c,OP_LEAVE);
+    emit(c,OP_NIL);
+    stack(c,1);
+}
+
+static CODE* compile_code(NODE *forms) {
+    COMPILER c = { NIL, 0, 0, NIL, 0, 0, 0, 0 };
+    compile_prog(&c,forms,true);
+    emit(&c,OP_RETURN);
+    CODE *code = (CODE*)alloc_VALUE(ID_CODE,sizeof(CODE));
+    code->type = ID_CODE;
+    code->flags = 0;
+    code->refc = 1;
+    code->ops = c.ops;
+    code->len = c.len;
+    code->consts = c.consts;
+    code->nconsts = c.nconsts;
+    code->depth = c.max;
+    return code;
+}
+
+//the closure template is (vars . (CODE)), so call_function can run it too
+static void compile_lambda(COMPILER *c, NODE *form) {
+    NODE *lambda = asNODE(form->addr);
+    if (!lambda || !lambda->addr) {
+        compile_push(c,OP_EVAL,(VALUE*)form);
+        return;
+    }
+    if (lambda->flags & FLAG_LAZY) { //compiled by compile_body on the first call
+        compile_push(c,OP_CLOSURE,(VALUE*)lambda);
+        return;
+    }
+    incRef(lambda->data);
+    NODE *proto = newNODE(lambda->data,newNODE(compile_code(asNODE(lambda->addr)),NIL));
+    compile_push(c,OP_CLOSURE,(VALUE*)proto);
+    decRef(proto);
+}
+
+static void compile_form(COMPILER *c, NODE *form, bool tail) {
+    NODE *args = asNODE(form->addr);
+    if (form->data && typeOf(form->data) == ID_PRIMFUNC) {
+        PRIMFUNC *prim = (PRIMFUNC*)form->data;
+        switch (prim->spec) {
+            case SPEC_FUNC: {
+                int n = compile_args(c,args);
+                emit(c,OP_CALLPRIM);
+                emit(c,constant(c,(VALUE*)prim));
+                emit(c,n);
+                stack(c,1-n);
+                return;
+            }
+            case SPEC_QUOTE:
+                if (!args || args->addr) break;
+                constify(args->data);
+                compile_push(c,OP_CONST,args->data);
+                return;
+            case SPEC_LAMBDA:
+                compile_lambda(c,form);
+                return;
+            case SPEC_MACRO:
+                if (prim->native == (NATIVE_FUNC)l_cond) {
+                    compile_cond(c,args,tail);
+                    return;
+                } else if (prim->native == (NATIVE_FUNC)l_prog) {
+                    compile_prog(c,args,tail);
+                    return;
+                } else if (prim->native == (NATIVE_FUNC)l_list) {
+                    int n = compile_args(c,args);
+                    emit(c,OP_LIST);
+                    emit(c,n);
+                    stack(c,1-n);
+                    return;
+                } else if (prim->native == (NATIVE_FUNC)l_while) {
+                    compile_while(c,args);
+                    return;
+                } else if (prim->native == (NATIVE_FUNC)l_dotimes) {
+                    compile_loop(c,args,OP_DOTIMES);
+                    return;
+                } else if (prim->native == (NATIVE_FUNC)l_dolist) {
+                    compile_loop(c,args,OP_DOLIST);
+                    return;
+                }
+                break;
+        }
+        compile_push(c,OP_EVAL,(VALUE*)form);
+        return;
+    }
+    compile_expr(c,form->data,false);
+    emit(c,OP_ARGS);
+    emit(c,constant(c,(VALUE*)args));
+    emit(c,0);
+    size_t skip = c->len;
+    int n = compile_args(c,args);
+    emit(c,tail ? OP_TAILCALL : OP_CALL);
+    emit(c,n);
+    stack(c,-n);
+    patch(c,skip);
+}
+
+static void compile_expr(COMPILER *c, VALUE *val, bool tail) {
+    if (!val) {
+        emit(c,OP_NIL);
+        stack(c,1);
+        return;
+    }
+    switch (typeOf(val)) {
+        case ID_NODE:
+            compile_form(c,(NODE*)val,tail);
+            return;
+        case ID_SYMBOL:
+            compile_push(c,OP_GLOBAL,val);
+            return;
+        case ID_LOCAL:
+            emit(c,OP_LOCAL);
+            emit(c,((LOCAL*)val)->depth);
+            emit(c,((LOCAL*)val)->slot);
+            stack(c,1);
+            return;
+        default:
+            compile_push(c,OP_CONST,val);
+            return;
+    }
+}
+
+//replaces the body of a (vars . body) with a single CODE, in place so every
+//closure sharing it runs the compiled body
+void compile_body(NODE *lambda) {
+    NODE *body = asNODE(lambda->addr);
+    lambda->addr = (VALUE*)newNODE(compile_code(body),NIL);
+    decRef(body);
+}
+
+//returns a CODE that evaluates form, and takes the reference to form
+VALUE* compile(VALUE *form) {
+    NODE *forms = newNODE(form,NIL);
+    CODE *code = compile_code(forms);
+    decRef(forms);
+    return (VALUE*)code;
+}
@@ -0,0 +1,226 @@
+/**
+ *  Copyright 2013 by Benjamin J. Land (a.k.a. BenLand100)
+ *
+ *  This file is part of L, a virtual machine for a lisp-like language.
+ *
+ *  L is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  L is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with L. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gc.h"
+#include "hash.h"
+#include "memo.h"
+#include <setjmp.h>
+#include <time.h>
+
+GCSTATS gc_stats;
+
+#if defined TRACING_GC && !defined NO_SLAB
+
+static VALUE ***roots = NIL;
+static size_t roots_len = 0, roots_cap = 0;
+static char *stack_base = NIL;
+
+//heap memory scanned like the C stack: *bytes bytes at *base
+typedef struct {
+    void **base;
+    size_t *bytes;
+} AREA;
+static AREA *areas = NIL;
+static size_t areas_len = 0;
+
+static VALUE **mark_stack = NIL;
+static size_t mark_len = 0, mark_cap = 0;
+
+void gc_init(void *base) {
+    stack_base = (char*)base;
+    alloc_trigger = GC_MIN_SLABS;
+}
+
+void gc_root(VALUE **ref) {
+    if (roots_len == roots_cap) {
+        roots_cap = roots_cap ? roots_cap*2 : 16;
+        roots = (VALUE***)realloc(roots,roots_cap*sizeof(VALUE**));
+        failNIL(roots,"Out of memory");
+    }
+    roots[roots_len++] = ref;
+}
+
+void gc_area(void **base, size_t *bytes) {
+    areas = (AREA*)realloc(areas,(areas_len+1)*sizeof(AREA));
+    failNIL(areas,"Out of memory");
+    areas[areas_len].base = base;
+    areas[areas_len++].bytes = bytes;
+}
+
+#define mark_bit(slab,i) ((slab)->marks[(i)>>3] & (1<<((i)&7)))
+
+static inline bool gc_marked(VALUE *val) {
+    SLAB *slab = slab_of(val);
+    size_t i = slab_index(slab,val);
+    return mark_bit(slab,i) != 0;
+}
+
+static void gc_mark(VALUE *val) {
+    if (!val || isIMMEDIATE(val)) return;
+    SLAB *slab = slab_of(val);
+    size_t i = slab_index(slab,val);
+    if (mark_bit(slab,i)) return;
+    slab->marks[i>>3] |= 1<<(i&7);
+    if (mark_len == mark_cap) {
+        mark_cap = mark_cap ? mark_cap*2 : 1024;
+        mark_stack = (VALUE**)realloc(mark_stack,mark_cap*sizeof(VALUE*));
+        failNIL(mark_stack,"Out of memory");
+    }
+    mark_stack[mark_len++] = val;
+}
+
+//applies fn to each counted reference val holds
+static void gc_children(VALUE *val, void (*fn)(VALUE*)) {
+    switch (val->type) {
+        case ID_NODE:
+            fn(((NODE*)val)->data);
+            fn(((NODE*)val)->addr);
+            break;
+        case ID_FRAME: {
+            FRAME *frame = (FRAME*)val;
+            fn((VALUE*)frame->map);
+            fn((VALUE*)frame->spec);
+            for (size_t i = 0; i < frame->size; i++) fn(frame->slots[i]);
+            break;
+        }
+        case ID_CODE:
+            for (size_t i = 0; i < ((CODE*)val)->nconsts; i++) fn(((CODE*)val)->consts[i]);
+            break;
+        case ID_ARGSPEC:
+            fn(((ARGSPEC*)val)->vars);
+            fn((VALUE*)((ARGSPEC*)val)->env);
+            break;
+        case ID_ARRAY:
+            for (size_t i = 0; i < ((ARRAY*)val)->len; i++) fn(((ARRAY*)val)->items[i]);
+            break;
+        case ID_HASH:
+            hash_children((HASH*)val,fn);
+            break;
+        case ID_MEMO:
+            memo_children((MEMO*)val,fn);
+            break;
+    }
+}
+
+//marks everything reachable from the mark stack without recursion
+static void gc_trace() {
+    while (mark_len) gc_children(mark_stack[--mark_len],gc_mark);
+}
+
+//any aligned word that lands inside a live cell keeps that cell alive
+static void gc_scan(char *lo, char *hi) {
+    lo = (char*)(((uintptr_t)lo) & ~(sizeof(void*) - 1));
+    for (; lo + sizeof(void*) <= hi; lo += sizeof(void*)) {
+        void *word = *(void**)lo;
+        SLAB *slab = alloc_slab(word);
+        if (!slab || (char*)word < slab_cells(slab)) continue;
+        size_t i = slab_index(slab,word);
+        if (i >= slab->cells) continue;
+        VALUE *cell = (VALUE*)(slab_cells(slab) + i*slab->size);
+        if (cell->type != ID_FREE) gc_mark(cell);
+    }
+}
+
+static void __attribute__((noinline)) gc_scanStack() {
+    jmp_buf regs;
+    setjmp(regs); //spills callee-saved registers onto the stack
+    char *top = (char*)&regs;
+    if (top < stack_base) {
+        gc_scan(top,stack_base);
+    } else {
+        gc_scan(stack_base,top + sizeof(regs));
+    }
+}
+
+#ifndef NO_REFC
+static void gc_unref(VALUE *val) {
+    if (val && !isIMMEDIATE(val) && gc_marked(val) && val->refc) val->refc--;
+}
+#endif
+
+static size_t gc_sweep() {
+    size_t freed = 0;
+#ifndef NO_REFC
+    //garbage may still hold counted references to survivors; drop them first
+    for (int type = 0; type < ALLOC_TYPES; type++) {
+        for (SLAB *slab = alloc_pools[type].slabs; slab; slab = slab->next) {
+            for (size_t i = 0; i < slab->cells; i++) {
+                VALUE *val = (VALUE*)(slab_cells(slab) + i*slab->size);
+                if (val->type == ID_FREE || mark_bit(slab,i)) continue;
+                gc_children(val,gc_unref);
+            }
+        }
+    }
+#endif
+    for (int type = 0; type < ALLOC_TYPES; type++) {
+        for (SLAB *slab = alloc_pools[type].slabs; slab; slab = slab->next) {
+            for (size_t i = 0; i < slab->cells; i++) {
+                VALUE *val = (VALUE*)(slab_cells(slab) + i*slab->size);
+                if (val->type == ID_FREE || mark_bit(slab,i)) continue;
+                finalizeVALUE(val);
+                free_VALUE(val,val->type);
+                freed++;
+            }
+            memset(slab->marks,0,sizeof(slab->marks));
+        }
+    }
+    return freed;
+}
+
+size_t gc_collect() {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC,&start);
+    freeDeferred((size_t)-1); //pending dead objects must not be swept twice
+    for (size_t i = 0; i < roots_len; i++) gc_mark(*roots[i]);
+    gc_trace();
+    gc_scanStack();
+    for (size_t i = 0; i < areas_len; i++) {
+        if (*areas[i].base) gc_scan((char*)*areas[i].base,(char*)*areas[i].base + *areas[i].bytes);
+    }
+    gc_trace();
+    hash_prune(gc_marked);
+    size_t freed = gc_sweep();
+    //let the heap grow to twice the live set before the next collection
+    size_t live_slabs = alloc_live() * sizeof(NODE) / ALLOC_SLAB;
+    alloc_trigger = alloc_slabs + 1;
+    if (alloc_trigger < 2*live_slabs) alloc_trigger = 2*live_slabs;
+    if (alloc_trigger < GC_MIN_SLABS) alloc_trigger = GC_MIN_SLABS;
+    alloc_pressure = 0;
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    size_t pause = ((end.tv_sec - start.tv_sec) * 1000000000 + (end.tv_nsec - start.tv_nsec)) / 1000;
+    gc_stats.collections++;
+    gc_stats.freed += freed;
+    gc_stats.last_pause = pause;
+    gc_stats.total_pause += pause;
+    if (pause > gc_stats.max_pause) gc_stats.max_pause = pause;
+    debug("gc: freed %u cells in %uus\n",(unsigned int)freed,(unsigned int)pause);
+    return freed;
+}
+
+#else
+
+void gc_init(void *base) { }
+void gc_root(VALUE **ref) { }
+void gc_area(void **base, size_t *bytes) { }
+
+size_t gc_collect() {
+    error("Tracing collector not available; build with -DTRACING_GC");
+}
+
+#endif
@@ -0,0 +1,53 @@
+/**
+ *  Copyright 2013 by Benjamin J. Land (a.k.a. BenLand100)
+ *
+ *  This file is part of L, a virtual machine for a lisp-like language.
+ *
+ *  L is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  L is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with L. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GC
+#define _GC
+
+#include "lisp.h"
+
+//mark-sweep collector over the slab heap, compiled in with -DTRACING_GC.
+//runs alongside reference counting to reclaim cycles (closure <-> scope), or
+//instead of it with -DNO_REFC. roots are the registered globals plus a
+//conservative scan of the C stack and of heap areas registered with gc_area.
+//a collection is requested once the heap grows to alloc_trigger slabs and
+//runs at the next evaluate.
+
+#define GC_MIN_SLABS    16
+
+typedef struct {
+    size_t collections;
+    size_t freed;
+    size_t last_pause,max_pause,total_pause; //microseconds
+} GCSTATS;
+
+extern GCSTATS gc_stats;
+
+void gc_init(void *stack_base);
+void gc_root(VALUE **ref);
+void gc_area(void **base, size_t *bytes);
+size_t gc_collect();
+
+#ifdef TRACING_GC
+    #define gc_poll() if (alloc_pressure) gc_collect();
+#else
+    #define gc_poll() { }
+#endif
+
+#endif
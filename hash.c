@@ -0,0 +1,334 @@
+/**
+ *  Copyright 2013 by Benjamin J. Land (a.k.a. BenLand100)
+ *
+ *  This file is part of L, a virtual machine for a lisp-like language.
+ *
+ *  L is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  L is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with L. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hash.h"
+
+#define HASH_MIN        8
+
+VALUE hash_tomb;
+
+static bool hash_byValue(VALUE *key) {
+    switch (typeOf(key)) {
+        case ID_SYMBOL:
+        case ID_INTEGER:
+        case ID_REAL:
+        case ID_STRING:
+            return true;
+    }
+    return false;
+}
+
+static size_t hash_key(VALUE *key) {
+    if (!key) return 0;
+    size_t h = hash_byValue(key) ? hashVALUE(key) : (size_t)(uintptr_t)key;
+    h ^= h >> 16;
+    h *= (size_t)0x45D9F3B3335B369ULL;
+    return h ^ (h >> 16);
+}
+
+static bool hash_same(VALUE *a, VALUE *b) {
+    return a == b || (a && b && typeOf(a) == typeOf(b) && hash_byValue(a) && equalVALUE(a,b));
+}
+
+static void table_init(HASHTABLE *table, size_t cap) {
+    table->slots = (HASHSLOT*)calloc(cap,sizeof(HASHSLOT));
+    failNIL(table->slots,"Out of memory");
+    table->cap = cap;
+    table->used = 0;
+}
+
+static HASHSLOT* table_find(HASHTABLE *table, VALUE *key, size_t hash) {
+    if (!table->slots) return NIL;
+    for (size_t i = hash & (table->cap-1); ; i = (i+1) & (table->cap-1)) {
+        HASHSLOT *slot = &table->slots[i];
+        if (!slot->key) return NIL;
+        if (slot->key != HASH_TOMB && slot->hash == hash && hash_same(slot->key,key)) return slot;
+    }
+}
+
+//key must not be in table already; takes the references to key and val
+static void table_insert(HASHTABLE *table, VALUE *key, VALUE *val, size_t hash) {
+    size_t i = hash & (table->cap-1);
+    while (table->slots[i].key && table->slots[i].key != HASH_TOMB) i = (i+1) & (table->cap-1);
+    if (!table->slots[i].key) table->used++;
+    table->slots[i].key = key;
+    table->slots[i].val = val;
+    table->slots[i].hash = hash;
+}
+
+//moves up to n slots of the old table into the current one
+static void hash_move(HASH *hash, size_t n) {
+    while (hash->old.slots && n--) {
+        HASHSLOT *slot = &hash->old.slots[hash->moved++];
+        if (slot->key && slot->key != HASH_TOMB) {
+            table_insert(&hash->cur,slot->key,slot->val,slot->hash);
+            slot->key = HASH_TOMB; //keeps the probe chains of the rest intact
+        }
+        if (hash->moved == hash->old.cap) {
+            free(hash->old.slots);
+            hash->old.slots = NIL;
+        }
+    }
+}
+
+//starts moving everything into a table with room for four times the keys.
+//filling it to 3/4 takes at least cap/2 more inserts, and the old table is
+//emptied within cap/4 operations
+static void hash_grow(HASH *hash) {
+    hash_move(hash,(size_t)-1);
+    size_t cap = HASH_MIN;
+    while (cap < hash->count*4) cap *= 2;
+    hash->old = hash->cur;
+    hash->moved = 0;
+    hash->step = hash->old.cap / (cap/4) + 1;
+    table_init(&hash->cur,cap);
+}
+
+static HASHSLOT* hash_find(HASH *hash, VALUE *key, size_t h) {
+    HASHSLOT *slot = table_find(&hash->cur,key,h);
+    return slot ? slot : table_find(&hash->old,key,h);
+}
+
+HASH* newHASH(size_t size) {
+    HASH *hash = (HASH*)alloc_VALUE(ID_HASH,sizeof(HASH));
+    hash->type = ID_HASH;
+    hash->flags = 0;
+    hash->refc = 1;
+    hash->count = 0;
+    size_t cap = HASH_MIN;
+    while (cap*3 < size*4) cap *= 2;
+    table_init(&hash->cur,cap);
+    hash->old.slots = NIL;
+    hash->old.cap = hash->old.used = 0;
+    hash->moved = 0;
+    hash->step = 1;
+    return hash;
+}
+
+//returned without a new reference
+VALUE* hash_get(HASH *hash, VALUE *key, bool *found) {
+    failNIL(key,"NIL cannot be a HASH key");
+    hash_move(hash,hash->step);
+    HASHSLOT *slot = hash_find(hash,key,hash_key(key));
+    *found = slot != NIL;
+    return slot ? slot->val : NIL;
+}
+
+void hash_put(HASH *hash, VALUE *key, VALUE *val) {
+    failNIL(key,"NIL cannot be a HASH key");
+    size_t h = hash_key(key);
+    hash_move(hash,hash->step);
+    incRef(val);
+    HASHSLOT *slot = hash_find(hash,key,h);
+    if (slot) {
+        decRef(slot->val);
+        slot->val = val;
+        return;
+    }
+    if ((hash->cur.used+1)*4 > hash->cur.cap*3) hash_grow(hash);
+    incRef(key);
+    table_insert(&hash->cur,key,val,h);
+    hash->count++;
+}
+
+bool hash_remove(HASH *hash, VALUE *key) {
+    failNIL(key,"NIL cannot be a HASH key");
+    hash_move(hash,hash->step);
+    HASHSLOT *slot = hash_find(hash,key,hash_key(key));
+    if (!slot) return false;
+    decRef(slot->key);
+    decRef(slot->val);
+    slot->key = HASH_TOMB;
+    slot->val = NIL;
+    hash->count--;
+    return true;
+}
+
+static NODE* table_pairs(HASHTABLE *table, size_t from, NODE *list) {
+    for (size_t i = from; table->slots && i < table->cap; i++) {
+        HASHSLOT *slot = &table->slots[i];
+        if (!slot->key || slot->key == HASH_TOMB) continue;
+        incRef(slot->key);
+        incRef(slot->val);
+        list = newNODE(newNODE(slot->key,slot->val),list);
+    }
+    return list;
+}
+
+//a list of (key . val), a snapshot safe to walk while the table changes
+NODE* hash_pairs(HASH *hash) {
+    return table_pairs(&hash->old,hash->moved,table_pairs(&hash->cur,0,NIL));
+}
+
+static void table_children(HASHTABLE *table, size_t from, void (*fn)(VALUE*)) {
+    for (size_t i = from; table->slots && i < table->cap; i++) {
+        if (!table->slots[i].key || table->slots[i].key == HASH_TOMB) continue;
+        fn(table->slots[i].key);
+        fn(table->slots[i].val);
+    }
+}
+
+//applies fn to each key and value
+void hash_children(HASH *hash, void (*fn)(VALUE*)) {
+    table_children(&hash->cur,0,fn);
+    table_children(&hash->old,hash->moved,fn);
+}
+
+//the hash-consing table: every interned NODE, held weakly. a NODE leaves it when
+//it dies, through hash_forget or, for the tracing collector, hash_prune
+static NODE **conses = NIL;
+static size_t conses_cap = 0, conses_used = 0, conses_count = 0;
+
+#define CONS_TOMB ((NODE*)HASH_TOMB)
+
+static size_t cons_hash(VALUE *data, VALUE *addr) {
+    return hash_key(data) * 31 + hash_key(addr);
+}
+
+//GC_DEBUG leaves dead cells in place, marked as free
+#define cons_live(node) ((node) != CONS_TOMB && (node)->type == ID_NODE)
+
+static void conses_insert(NODE **table, size_t cap, NODE *node) {
+    size_t i = cons_hash(node->data,node->addr) & (cap-1);
+    while (table[i]) i = (i+1) & (cap-1);
+    table[i] = node;
+}
+
+//rehashes into a table with room for four times the live conses
+static void conses_grow() {
+    size_t cap = 64;
+    while (cap < conses_count*4) cap *= 2;
+    NODE **table = (NODE**)calloc(cap,sizeof(NODE*));
+    failNIL(table,"Out of memory");
+    conses_count = 0;
+    for (size_t i = 0; i < conses_cap; i++) {
+        if (!conses[i] || !cons_live(conses[i])) continue;
+        conses_insert(table,cap,conses[i]);
+        conses_count++;
+    }
+    free(conses);
+    conses = table;
+    conses_cap = cap;
+    conses_used = conses_count;
+}
+
+//a child the table compares the way EQUAL does: by value, or interned itself
+static bool cons_canonical(VALUE *val) {
+    return !val || hash_byValue(val) || (typeOf(val) == ID_NODE && (val->flags & FLAG_INTERNED));
+}
+
+//the one interned (data . addr), made if there is none yet; takes the references
+//to data and addr like newNODE. a pair holding anything else, such as an ARRAY
+//EQUAL compares by its items, gets a new constant NODE that is not interned
+NODE* hash_cons(VALUE *data, VALUE *addr) {
+    if (!cons_canonical(data) || !cons_canonical(addr)) {
+        NODE *node = newNODE(data,addr);
+        node->flags |= FLAG_CONST;
+        return node;
+    }
+    size_t h = cons_hash(data,addr);
+    for (size_t i = conses_cap ? h & (conses_cap-1) : 0; conses_cap && conses[i]; i = (i+1) & (conses_cap-1)) {
+        NODE *node = conses[i];
+        if (cons_live(node) && hash_same(node->data,data) && hash_same(node->addr,addr)) {
+            decRef(data);
+            decRef(addr);
+            incRef(node);
+            return node;
+        }
+    }
+    if ((conses_used+1)*4 > conses_cap*3) conses_grow();
+    NODE *node = newNODE(data,addr);
+    node->flags |= FLAG_CONST | FLAG_INTERNED;
+    size_t i = h & (conses_cap-1);
+    while (conses[i] && conses[i] != CONS_TOMB) i = (i+1) & (conses_cap-1);
+    if (!conses[i]) conses_used++;
+    conses[i] = node;
+    conses_count++;
+    return node;
+}
+
+static bool cons_shareable(VALUE *val) {
+    return val && typeOf(val) == ID_NODE && ((NODE*)val)->datatype == DATA_NODE && !(val->flags & FLAG_INTERNED);
+}
+
+//the interned copy of val: NODE lists and trees are rebuilt from the leaves up
+//through hash_cons, anything else is returned as it is. walks with two explicit
+//stacks, of NODEs to rebuild, each above a marker saying which of its halves
+//comes next, and of the halves already rebuilt
+VALUE* hash_share(VALUE *val) {
+    if (!cons_shareable(val)) {
+        incRef(val);
+        return val;
+    }
+    WALK todo, done;
+    walk_init(&todo);
+    walk_init(&done);
+    walk_push(&todo,val);
+    walk_push(&todo,NIL); //data next
+    while (todo.len) {
+        VALUE *half = todo.vals[--todo.len];
+        NODE *node = (NODE*)todo.vals[todo.len-1];
+        if (half == HASH_TOMB) { //both halves done
+            todo.len--;
+            VALUE *addr = done.vals[--done.len];
+            VALUE *data = done.vals[--done.len];
+            walk_push(&done,(VALUE*)hash_cons(data,addr));
+            continue;
+        }
+        VALUE *next = half ? node->addr : node->data;
+        walk_push(&todo,half ? HASH_TOMB : (VALUE*)node);
+        if (cons_shareable(next)) {
+            walk_push(&todo,next);
+            walk_push(&todo,NIL);
+        } else {
+            incRef(next);
+            walk_push(&done,next);
+        }
+    }
+    val = done.vals[0];
+    walk_free(&todo);
+    walk_free(&done);
+    return val;
+}
+
+static void conses_remove(NODE *node) {
+    size_t i = cons_hash(node->data,node->addr) & (conses_cap-1);
+    for (; conses[i]; i = (i+1) & (conses_cap-1)) {
+        if (conses[i] == node) {
+            conses[i] = CONS_TOMB;
+            conses_count--;
+            return;
+        }
+    }
+}
+
+//drops an interned NODE that is dying, before its children are released
+void hash_forget(NODE *node) {
+    conses_remove(node);
+}
+
+//drops every interned NODE the tracing collector is about to sweep
+void hash_prune(bool (*live)(VALUE *val)) {
+    for (size_t i = 0; i < conses_cap; i++) {
+        if (conses[i] && conses[i] != CONS_TOMB && (!cons_live(conses[i]) || !live((VALUE*)conses[i]))) {
+            conses[i] = CONS_TOMB;
+            conses_count--;
+        }
+    }
+}
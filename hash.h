@@ -0,0 +1,49 @@
+/**
+ *  Copyright 2013 by Benjamin J. Land (a.k.a. BenLand100)
+ *
+ *  This file is part of L, a virtual machine for a lisp-like language.
+ *
+ *  L is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  L is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with L. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HASH
+#define _HASH
+
+#include "lisp.h"
+
+//hash tables keyed by value for SYMBOLs, INTEGERs, REALs and STRINGs and by
+//identity for anything else. open addressing with linear probing; removed
+//keys leave a tombstone until the next resize. a resize does not rehash at
+//once: the old table is kept and each later operation moves a few of its
+//slots into the new one, so lookups check both until it is empty.
+//
+//hash_cons interns immutable NODEs: equal (data . addr) pairs built through it
+//are one NODE, so EQUAL on two interned values is a pointer comparison. only
+//pairs whose halves are by value or interned themselves are interned; one that
+//holds an ARRAY, say, which EQUAL compares by its items, is left a plain
+//constant NODE. the table of interned NODEs does not keep them alive.
+
+HASH* newHASH(size_t size);
+VALUE* hash_get(HASH *hash, VALUE *key, bool *found);
+void hash_put(HASH *hash, VALUE *key, VALUE *val);
+bool hash_remove(HASH *hash, VALUE *key);
+NODE* hash_pairs(HASH *hash);
+void hash_children(HASH *hash, void (*fn)(VALUE*));
+
+NODE* hash_cons(VALUE *data, VALUE *addr);
+VALUE* hash_share(VALUE *val);
+void hash_forget(NODE *node);
+void hash_prune(bool (*live)(VALUE *val));
+
+#endif
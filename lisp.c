@@ -23,93 +23,407 @@
 #include "parser.h"
 #include "binmap.h"
 #include "listops.h"
+#include "gc.h"
+#include "resolve.h"
+#include "bytecode.h"
+#include "vector.h"
+#include "hash.h"
+#include "memo.h"
 #include <string.h>
 
-void freeVALUE(VALUE *val) {
+//dead objects are pushed on a work list linked through their refc field, so
+//releasing a long list never recurses; with LAZY_FREE the list is drained
+//LAZY_FREE_BUDGET objects per allocation instead of right away
+void *free_dead = NIL;
+static bool free_draining = false;
+
+static void freeChild(VALUE *val) {
+    decRef(val);
+}
+
+void freeDeferred(size_t budget) {
+    if (free_draining) return;
+    free_draining = true;
+    while (free_dead && budget--) {
+        VALUE *val = (VALUE*)free_dead;
+        free_dead = (void*)val->refc;
+        switch (val->type) {
+            case ID_NODE:
+                decRef(((NODE*)val)->data);
+                decRef(((NODE*)val)->addr);
+                break;
+            case ID_FRAME: {
+                FRAME *frame = (FRAME*)val;
+                decRef(frame->map);
+                decRef(frame->spec);
+                for (size_t i = 0; i < frame->size; i++) decRef(frame->slots[i]);
+                break;
+            }
+            case ID_CODE:
+                for (size_t i = 0; i < ((CODE*)val)->nconsts; i++) decRef(((CODE*)val)->consts[i]);
+                break;
+            case ID_ARGSPEC:
+                decRef(((ARGSPEC*)val)->vars);
+                decRef(((ARGSPEC*)val)->env);
+                break;
+            case ID_ARRAY:
+                for (size_t i = 0; i < ((ARRAY*)val)->len; i++) decRef(((ARRAY*)val)->items[i]);
+                break;
+            case ID_HASH:
+                hash_children((HASH*)val,freeChild);
+                break;
+            case ID_MEMO:
+                memo_children((MEMO*)val,freeChild);
+                break;
+        }
+        finalizeVALUE(val);
+        free_VALUE(val,val->type);
+    }
+    free_draining = false;
+}
+
+//releases storage a VALUE owns outside of the heap
+void finalizeVALUE(VALUE *val) {
     switch (val->type) {
-        case ID_NODE:
-            decRef(((NODE*)val)->data);
-            decRef(((NODE*)val)->addr);
-            break;
         case ID_STRING:
             free(((STRING*)val)->str);
             break;
+        case ID_FRAME:
+            if (((FRAME*)val)->slots != ((FRAME*)val)->inline_slots) free(((FRAME*)val)->slots);
+            break;
+        case ID_CODE:
+            free(((CODE*)val)->ops);
+            free(((CODE*)val)->consts);
+            break;
+        case ID_ARGSPEC:
+            free(((ARGSPEC*)val)->syms);
+            free(((ARGSPEC*)val)->captures);
+            break;
+        case ID_VECTOR:
+            free(((VECTOR*)val)->data);
+            break;
+        case ID_ARRAY:
+            free(((ARRAY*)val)->items);
+            break;
+        case ID_HASH:
+            free(((HASH*)val)->cur.slots);
+            free(((HASH*)val)->old.slots);
+            break;
+        case ID_MEMO:
+            memo_finalize((MEMO*)val);
+            break;
     }
-    free(val);
 }
 
+void freeVALUE(VALUE *val) {
+    if (val->flags & FLAG_INTERNED) hash_forget((NODE*)val); //lookups must not find it while its free is deferred
+    val->refc = (size_t)free_dead;
+    free_dead = val;
+#ifndef LAZY_FREE
+    freeDeferred((size_t)-1);
+#endif
+}
+
+//copies the NODEs of val, iterating along each list; the data fields and ARRAY
+//items still to copy wait on an explicit stack as (destination, source) pairs
 VALUE* deep_copy(VALUE *val) {
-    if (!val) return NIL;
-    switch (val->type) {
+    VALUE *head = NIL;
+    WALK walk;
+    walk_init(&walk);
+    walk_push(&walk,(VALUE*)&head);
+    walk_push(&walk,val);
+    while (walk.len) {
+        val = walk.vals[--walk.len];
+        VALUE **tail = (VALUE**)walk.vals[--walk.len];
+        while (val && !isIMMEDIATE(val) && val->type == ID_NODE) {
+            NODE *copy = newNODE(NIL,NIL);
+            *tail = (VALUE*)copy;
+            walk_push(&walk,(VALUE*)&copy->data);
+            walk_push(&walk,((NODE*)val)->data);
+            tail = &copy->addr;
+            val = ((NODE*)val)->addr;
+        }
+        if (val && !isIMMEDIATE(val)) {
+            switch (val->type) {
+                case ID_SYMBOL:
+                case ID_INTEGER:
+                case ID_REAL:
+                case ID_STRING:
+                case ID_PRIMFUNC:
+                case ID_LOCAL:
+                case ID_ARGSPEC:
+                case ID_VECTOR:
+                case ID_HASH:
+                case ID_MEMO:
+                    incRef(val);
+                    break;
+                case ID_ARRAY: {
+                    ARRAY *arr = (ARRAY*)val, *copy = newARRAY(arr->len);
+                    for (size_t i = 0; i < arr->len; i++) {
+                        walk_push(&walk,(VALUE*)&copy->items[i]);
+                        walk_push(&walk,arr->items[i]);
+                    }
+                    val = (VALUE*)copy;
+                    break;
+                }
+                default:
+                    error("Cannot copy a non-value");
+            }
+        }
+        *tail = val;
+    }
+    walk_free(&walk);
+    return head;
+}
+
+//marks a structure immutable so it can be shared rather than copied
+void constify(VALUE *val) {
+    while (!isCONST(val)) {
+        val->flags |= FLAG_CONST;
+        if (val->type != ID_NODE) return;
+        constify(((NODE*)val)->data);
+        val = ((NODE*)val)->addr;
+    }
+}
+
+#define hash_mix(h,x) (((h) ^ (size_t)(x)) * (size_t)1099511628211ULL)
+#define HASH_NODE       ((size_t)0x9E3779B97F4A7C15ULL) //mixed in for each NODE, so shapes differ
+
+static inline size_t hash_real(size_t h, T_REAL r) {
+    uint64_t bits = 0;
+    if (r != 0) memcpy(&bits,&r,sizeof(r)); //0.0 == -0.0
+    return hash_mix(h,bits ^ (bits >> 32));
+}
+
+//structural hash, consistent with equalVALUE
+size_t hashVALUE(VALUE *val) {
+    size_t h = (size_t)14695981039346656037ULL;
+    WALK walk;
+    walk_init(&walk);
+    walk_push(&walk,val);
+    while (walk.len) {
+        val = walk.vals[--walk.len];
+        if (!val) {
+            h = hash_mix(h,0);
+            continue;
+        }
+        switch (typeOf(val)) {
+            case ID_NODE:
+                h = hash_mix(h,HASH_NODE);
+                walk_push(&walk,((NODE*)val)->addr);
+                walk_push(&walk,((NODE*)val)->data);
+                break;
+            case ID_SYMBOL:
+                h = hash_mix(h,((SYMBOL*)val)->sym + 1);
+                break;
+            case ID_INTEGER:
+                h = hash_mix(h,asINTEGER(val));
+                break;
+            case ID_REAL:
+                h = hash_real(h,asREAL(val));
+                break;
+            case ID_STRING:
+                for (char *c = ((STRING*)val)->str; *c; c++) h = hash_mix(h,*c);
+                break;
+            case ID_PRIMFUNC:
+                h = hash_mix(h,(uintptr_t)((PRIMFUNC*)val)->native);
+                break;
+            case ID_ARRAY:
+                h = hash_mix(h,((ARRAY*)val)->len);
+                for (size_t i = ((ARRAY*)val)->len; i--; ) walk_push(&walk,((ARRAY*)val)->items[i]);
+                break;
+            case ID_VECTOR: {
+                VECTOR *vec = (VECTOR*)val;
+                for (size_t i = 0; i < vec->len; i++) {
+                    if (vec->elem == VEC_REAL) {
+                        h = hash_real(h,vec_reals(vec)[i]);
+                    } else {
+                        h = hash_mix(h,vec_ints(vec)[i]);
+                    }
+                }
+                break;
+            }
+            default:
+                h = hash_mix(h,(uintptr_t)val);
+                break;
+        }
+    }
+    walk_free(&walk);
+    return h;
+}
+
+//compares two atoms, or the top level of two ARRAYs or NODEs whose children
+//still have to be compared
+static bool equal_shallow(VALUE *a, VALUE *b) {
+    if (!a || !b || typeOf(a) != typeOf(b)) return false;
+    switch (typeOf(a)) {
         case ID_NODE:
-            return (VALUE*)newNODE(deep_copy(((NODE*)val)->data),deep_copy(((NODE*)val)->addr));
+            if (a->flags & b->flags & FLAG_INTERNED) return false; //equal ones are the same NODE
+            return ((NODE*)a)->datatype == ((NODE*)b)->datatype;
         case ID_SYMBOL:
-            return (VALUE*)newSYMBOL(((SYMBOL*)val)->sym);
+            return ((SYMBOL*)a)->sym == ((SYMBOL*)b)->sym;
         case ID_INTEGER:
-            return (VALUE*)newINTEGER(((INTEGER*)val)->val);
+            return asINTEGER(a) == asINTEGER(b);
         case ID_REAL:
-            return (VALUE*)newREAL(((REAL*)val)->val);
+            return asREAL(a) == asREAL(b);
         case ID_STRING:
-            return (VALUE*)newSTRING(strdup(((STRING*)val)->str));
+            return !strcmp(((STRING*)a)->str,((STRING*)b)->str);
         case ID_PRIMFUNC:
-            return (VALUE*)newPRIMFUNC(((PRIMFUNC*)val)->spec,((PRIMFUNC*)val)->native);
+            return !cmpPRIMFUNC((PRIMFUNC*)a,(PRIMFUNC*)b);
+        case ID_ARRAY:
+            return ((ARRAY*)a)->len == ((ARRAY*)b)->len;
+        case ID_VECTOR: {
+            VECTOR *va = (VECTOR*)a, *vb = (VECTOR*)b;
+            if (va->elem != vb->elem || va->len != vb->len) return false;
+            for (size_t i = 0; i < va->len; i++) {
+                if (va->elem == VEC_REAL ? vec_reals(va)[i] != vec_reals(vb)[i] : vec_ints(va)[i] != vec_ints(vb)[i]) return false;
+            }
+            return true;
+        }
     }
-    error("Cannot copy a non-value");
+    return false;
 }
 
-void printList(NODE *list) {
-    if (list->addr) {
-        if (list->addr->type == ID_NODE) {
-            print(list->data);
-            printList((NODE*)list->addr);
-        } else {
-            print(asVALUE(list));
+//same shape and equal atoms; anything else is equal only to itself
+bool equalVALUE(VALUE *a, VALUE *b) {
+    bool equal = true;
+    WALK walk; //pairs still to compare
+    walk_init(&walk);
+    walk_push(&walk,a);
+    walk_push(&walk,b);
+    while (walk.len) {
+        b = walk.vals[--walk.len];
+        a = walk.vals[--walk.len];
+        if (a == b) continue;
+        if (!equal_shallow(a,b)) {
+            equal = false;
+            break;
+        }
+        if (typeOf(a) == ID_NODE) {
+            walk_push(&walk,((NODE*)a)->addr);
+            walk_push(&walk,((NODE*)b)->addr);
+            walk_push(&walk,((NODE*)a)->data);
+            walk_push(&walk,((NODE*)b)->data);
+        } else if (typeOf(a) == ID_ARRAY) {
+            for (size_t i = ((ARRAY*)a)->len; i--; ) {
+                walk_push(&walk,((ARRAY*)a)->items[i]);
+                walk_push(&walk,((ARRAY*)b)->items[i]);
+            }
         }
-    } else {    
-        print(list->data);
     }
+    walk_free(&walk);
+    return equal;
 }
 
-void print(VALUE *val) {
-    if (!val) {
-        printf("NIL ");
-        return;
+//markers on the print stack for the text that closes a list or an ARRAY, or
+//separates a dotted pair
+static VALUE print_close, print_closeArray, print_dot;
+
+//pushes the elements of list, last first; a dotted tail prints as a pair
+static void print_list(WALK *walk, NODE *list) {
+    size_t base = walk->len;
+    for (; list->addr && typeOf(list->addr) == ID_NODE; list = (NODE*)list->addr) walk_push(walk,list->data);
+    walk_push(walk,list->addr ? (VALUE*)list : list->data);
+    for (size_t i = base, j = walk->len-1; i < j; i++, j--) {
+        VALUE *swap = walk->vals[i];
+        walk->vals[i] = walk->vals[j];
+        walk->vals[j] = swap;
     }
-    switch (val->type) {
-        case ID_NODE:
-            switch (((NODE*)val)->datatype) {
-                case DATA_NODE:
-                case DATA_FUNCTION:
-                    printf("( ");
-                    if (((NODE*)val)->addr && ((NODE*)val)->addr->type != ID_NODE) {
-                        print(((NODE*)val)->data);
-                        printf(". ");
-                        print(((NODE*)val)->addr);
+}
+
+//prints with an explicit stack of the values and markers still to print
+void print(VALUE *val) {
+    WALK walk;
+    walk_init(&walk);
+    walk_push(&walk,val);
+    while (walk.len) {
+        val = walk.vals[--walk.len];
+        if (!val) {
+            printf("NIL ");
+            continue;
+        }
+        if (val == &print_close) {
+            printf(") ");
+            continue;
+        }
+        if (val == &print_closeArray) {
+            printf("] ");
+            continue;
+        }
+        if (val == &print_dot) {
+            printf(". ");
+            continue;
+        }
+        switch (typeOf(val)) {
+            case ID_NODE:
+                if (((NODE*)val)->datatype == DATA_SCOPE) {
+                    printf("SCOPE@%p ",(void*)val);
+                    break;
+                }
+                printf("( ");
+                walk_push(&walk,&print_close);
+                if (((NODE*)val)->addr && typeOf(((NODE*)val)->addr) != ID_NODE) {
+                    walk_push(&walk,((NODE*)val)->addr);
+                    walk_push(&walk,&print_dot);
+                    walk_push(&walk,((NODE*)val)->data);
+                } else {
+                    print_list(&walk,(NODE*)val);
+                }
+                break;
+            case ID_INTEGER:
+                printf("%i ", asINTEGER(val));
+                break;
+            case ID_REAL:
+                printf("%f ", asREAL(val));
+                break;
+            case ID_SYMBOL:
+                printf("%s ",sym_str((SYMBOL*)val));
+                break;
+            case ID_STRING:
+                printf("\"%s\"",((STRING*)val)->str);
+                break;
+            case ID_PRIMFUNC:
+                printf("%s ",prim_str((PRIMFUNC*)val));
+                break;
+            case ID_LOCAL:
+                printf("%s ",sym_name(((LOCAL*)val)->sym));
+                break;
+            case ID_FRAME:
+                printf("FRAME@%p ",(void*)val);
+                break;
+            case ID_CODE:
+                printf("CODE@%p ",(void*)val);
+                break;
+            case ID_ARGSPEC:
+                walk_push(&walk,((ARGSPEC*)val)->vars);
+                break;
+            case ID_HASH:
+                printf("HASH@%p ",(void*)val);
+                break;
+            case ID_MEMO:
+                printf("MEMO@%p ",(void*)val);
+                break;
+            case ID_ARRAY:
+                printf("[ ");
+                walk_push(&walk,&print_closeArray);
+                for (size_t i = ((ARRAY*)val)->len; i--; ) walk_push(&walk,((ARRAY*)val)->items[i]);
+                break;
+            case ID_VECTOR: {
+                VECTOR *vec = (VECTOR*)val;
+                printf("#( ");
+                for (size_t i = 0; i < vec->len; i++) {
+                    if (vec->elem == VEC_REAL) {
+                        printf("%f ",vec_reals(vec)[i]);
                     } else {
-                        printList(((NODE*)val));
+                        printf("%i ",vec_ints(vec)[i]);
                     }
-                    printf(") ");
-                    return;
-                case DATA_SCOPE:
-                    printf("SCOPE@%p ",(void*)val);
-                    return;
+                }
+                printf(") ");
+                break;
             }
-        case ID_INTEGER:
-            printf("%i ", ((INTEGER*)val)->val);
-            return;
-        case ID_REAL:
-            printf("%f ", ((REAL*)val)->val);
-            return;
-        case ID_SYMBOL:
-            printf("%s ",sym_str((SYMBOL*)val));
-            return;
-        case ID_STRING:
-            printf("\"%s\"",((STRING*)val)->str);
-            return;
-        case ID_PRIMFUNC:
-            printf("%s ",prim_str((PRIMFUNC*)val));
-            return;
+        }
     }
+    walk_free(&walk);
 }
 
 VALUE* prim_print(NODE *args, NODE *scope) {
@@ -121,70 +435,246 @@ VALUE* prim_print(NODE *args, NODE *scope) {
     return NIL;
 }
 
-VALUE* call_function(VALUE *func, NODE *args, NODE *scope) {
-    debugVal(func,"function form: ");
+//arguments for ABI_ARGV primitives are evaluated straight into slots of this
+//stack. it grows by chunks that never move, so a reservation stays valid while
+//nested calls reserve above it; the collector scans each chunk
+#define ARGS_CHUNK  1024
+
+typedef struct ARGCHUNK {
+    struct ARGCHUNK *prev, *next;
+    VALUE **vals;
+    size_t top, cap, bytes;
+} ARGCHUNK;
+
+static ARGCHUNK *args_chunk = NIL;
+
+VALUE** args_reserve(int argc) {
+    if (!args_chunk || args_chunk->top + argc > args_chunk->cap) {
+        ARGCHUNK *next = args_chunk ? args_chunk->next : NIL;
+        if (!next) {
+            next = (ARGCHUNK*)calloc(1,sizeof(ARGCHUNK));
+            failNIL(next,"Out of memory");
+            next->prev = args_chunk;
+            if (args_chunk) args_chunk->next = next;
+            gc_area((void**)&next->vals,&next->bytes);
+        }
+        if (next->cap < (size_t)argc || !next->vals) {
+            next->cap = argc > ARGS_CHUNK ? argc : ARGS_CHUNK;
+            next->vals = (VALUE**)realloc(next->vals,next->cap*sizeof(VALUE*));
+            failNIL(next->vals,"Out of memory");
+            next->bytes = next->cap*sizeof(VALUE*);
+        }
+        args_chunk = next;
+    }
+    VALUE **argv = args_chunk->vals + args_chunk->top;
+    args_chunk->top += argc;
+    return argv;
+}
+
+//drops the references held in the most recent reservation
+void args_release(VALUE **argv, int argc) {
+    for (int i = 0; i < argc; i++) decRef(argv[i]);
+    args_chunk->top -= argc;
+    if (!args_chunk->top && args_chunk->prev) args_chunk = args_chunk->prev;
+}
+
+//calls a SPEC_FUNC primitive on argument values it borrows
+VALUE* call_prim(PRIMFUNC *prim, int argc, VALUE **argv, NODE *scope) {
+    if (prim->abi == ABI_ARGV) return ((ARGV_FUNC)prim->native)(argc,argv,scope);
+    NODE *list = NIL;
+    for (int i = argc; i--; ) {
+        incRef(argv[i]);
+        list = newNODE(argv[i],list);
+    }
+    VALUE *res = prim->native(list,scope);
+    decRef(list);
+    return res;
+}
+
+//calls func on argument values it borrows, whatever the engine
+VALUE* apply_values(VALUE *func, int argc, VALUE **argv, NODE *scope) {
     failNIL(func,"NIL cannot be invoked");
-    switch (func->type) {
+    switch (typeOf(func)) {
         case ID_PRIMFUNC:
-            if (((PRIMFUNC*)func)->spec) { //quote for all but SPEC_FUNC
-                return ((PRIMFUNC*)func)->native(args,scope);
+            if (((PRIMFUNC*)func)->spec) error("Special forms cannot be applied to values");
+            return call_prim((PRIMFUNC*)func,argc,argv,scope);
+        case ID_NODE: {
+            NODE *lambda = asNODE(((NODE*)func)->addr);
+            lambda_force(lambda);
+            ARGSPEC *spec = scope_argspec(lambda);
+            NODE *fn_scope = scope_pushFrame(asNODE(((NODE*)func)->data),spec);
+            for (int i = 0; i < argc; i++) incRef(argv[i]);
+            scope_bindValues(spec,argv,argc,fn_scope);
+            VALUE *res = l_prog(asNODE(lambda->addr),fn_scope);
+            scope_pop(fn_scope);
+            return res;
+        }
+        case ID_MEMO:
+            return memo_call((MEMO*)func,argc,argv,scope);
+    }
+    error("Malfored function invoke");
+}
+
+//runs the body forms of a COND or PROG, or of a call to func, up to the form in
+//tail position. returns that form, leaving the scope to evaluate it in (a new
+//reference) in *tail_scope, or NIL if func was called outright with its result
+//in *res
+static VALUE* call_tail(VALUE *func, NODE *args, NODE *scope, VALUE **res, NODE **tail_scope) {
+    debugVal(func,"function form: ");
+    failNIL(func,"NIL cannot be invoked");
+    switch (typeOf(func)) {
+        case ID_PRIMFUNC: {
+            PRIMFUNC *prim = (PRIMFUNC*)func;
+            if (prim->native == (NATIVE_FUNC)l_cond) {
+                for (; args; args = asNODE(args->addr)) {
+                    NODE *test = asNODE(args->data);
+                    if (list_length(test) != 2) error("Malformed conditional");
+                    VALUE *v = evaluate(test->data,scope);
+                    if (v) {
+                        decRef(v);
+                        VALUE *form = asNODE(test->addr)->data;
+                        *res = NIL;
+                        if (form) {
+                            incRef(scope);
+                            *tail_scope = scope;
+                        }
+                        return form;
+                    }
+                }
+                *res = NIL;
+                return NIL;
+            } else if (prim->native == (NATIVE_FUNC)l_prog && args) {
+                for (; args->addr; args = asNODE(args->addr)) decRef(evaluate(args->data,scope));
+                *res = NIL;
+                if (!args->data) return NIL;
+                incRef(scope);
+                *tail_scope = scope;
+                return args->data;
+            } else if (prim->spec) { //quote for all but SPEC_FUNC
+                *res = prim->native(args,scope);
+            } else if (prim->abi == ABI_ARGV) {
+                int argc = list_length(args);
+                if (!argc) {
+                    *res = ((ARGV_FUNC)prim->native)(0,NIL,scope);
+                    return NIL;
+                }
+                VALUE **argv = args_reserve(argc);
+                for (int i = 0; i < argc; i++, args = (NODE*)args->addr) argv[i] = evaluate(args->data,scope);
+                *res = ((ARGV_FUNC)prim->native)(argc,argv,scope);
+                args_release(argv,argc);
             } else {
                 NODE *args_eval = l_list(args,scope);
-                VALUE *res = ((PRIMFUNC*)func)->native(args_eval,scope);
+                *res = prim->native(args_eval,scope);
                 decRef(args_eval);
-                return res;
             }
+            return NIL;
+        }
         case ID_NODE: {
-            NODE *fn_scope = scope_push(asNODE(((NODE*)func)->data));
-            NODE *fn_vars = asNODE(((NODE*)func)->addr) ? asNODE(((NODE*)((NODE*)func)->addr)->data) : NIL;
-            if (fn_vars && !fn_vars->addr && fn_vars->data->type == ID_NODE) {
-                fn_vars = asNODE(fn_vars->data); 
-                scope_bindArgs(fn_vars,args,fn_scope); //quote args
+            NODE *lambda = asNODE(((NODE*)func)->addr);
+            lambda_force(lambda);
+            ARGSPEC *spec = scope_argspec(lambda);
+            NODE *fn_scope = scope_pushFrame(asNODE(((NODE*)func)->data),spec);
+            if (spec->mode == ARGS_QUOTED) {
+                NODE *fn_args = (NODE*)resolve_strip((VALUE*)args); //quote args as written, not as resolved
+                scope_bindArgs(spec,fn_args,fn_scope);
+                decRef(fn_args);
             } else {
                 NODE *fn_args = l_list(args,scope); //eval args
                 debug("bind args\n");
-                scope_bindArgs(fn_vars,fn_args,fn_scope);
+                scope_bindArgs(spec,fn_args,fn_scope);
                 decRef(fn_args);
             }
             debug("evaluate body\n");
-            NODE *fn_body = asNODE(asNODE(((NODE*)func)->addr)->addr);
+            NODE *fn_body = asNODE(lambda->addr);
             while (fn_body->addr) {
                 decRef(evaluate(fn_body->data,fn_scope));
                 fn_body = asNODE(fn_body->addr);
             }
-            VALUE *res = evaluate(fn_body->data,fn_scope);
-            scope_pop(fn_scope);
-            return res;
+            if (!fn_body->data) {
+                scope_pop(fn_scope);
+                *res = NIL;
+                return NIL;
+            }
+            *tail_scope = fn_scope;
+            return fn_body->data;
+        }
+        case ID_MEMO: {
+            int argc = list_length(args);
+            VALUE **argv = args_reserve(argc);
+            for (int i = 0; i < argc; i++, args = (NODE*)args->addr) argv[i] = evaluate(args->data,scope);
+            *res = memo_call((MEMO*)func,argc,argv,scope);
+            args_release(argv,argc);
+            return NIL;
         }
     }
     error("Malfored function invoke");
 }
 
+VALUE* call_function(VALUE *func, NODE *args, NODE *scope) {
+    VALUE *res;
+    NODE *tail_scope;
+    VALUE *tail = call_tail(func,args,scope,&res,&tail_scope);
+    if (!tail) return res;
+    res = evaluate(tail,tail_scope);
+    decRef(tail_scope);
+    return res;
+}
+
+//a call in tail position replaces the form and scope being evaluated instead of
+//recursing, so the frame (and the function whose body holds the form) are kept
+//here until the next tail call or the result
 VALUE* evaluate(VALUE *val, NODE *scope) {
-    debugVal(val,"evaluate: ");
-    if (!val) return NIL;
-    switch (val->type) {
-        case ID_NODE: {
-            VALUE *func = evaluate(((NODE*)val)->data,scope);
-            NODE *args = asNODE(((NODE*)val)->addr);
-            VALUE *res = call_function(func,args,scope);
-            debugVal(res,"function result: ");
-            decRef(func);
-            return res;
+    NODE *frame = NIL;
+    VALUE *frame_func = NIL, *res;
+    for (;;) {
+        debugVal(val,"evaluate: ");
+        gc_poll();
+        if (!val) {
+            res = NIL;
+            break;
         }
-        case ID_SYMBOL: {
-            VALUE *v = scope_resolve(((SYMBOL*)val),scope);
-            return v;
+        switch (typeOf(val)) {
+            case ID_NODE: {
+                VALUE *func = evaluate(((NODE*)val)->data,scope);
+                NODE *args = asNODE(((NODE*)val)->addr);
+                NODE *tail_scope;
+                VALUE *tail = call_tail(func,args,scope,&res,&tail_scope);
+                if (tail) {
+                    decRef(frame);
+                    decRef(frame_func);
+                    frame = scope = tail_scope;
+                    frame_func = func;
+                    val = tail;
+                    continue;
+                }
+                debugVal(res,"function result: ");
+                decRef(func);
+                break;
+            }
+            case ID_SYMBOL:
+                res = scope_resolve(((SYMBOL*)val),scope);
+                break;
+            case ID_LOCAL:
+                res = scope_local((LOCAL*)val,scope);
+                break;
+            case ID_CODE:
+                res = vm_run((CODE*)val,scope);
+                break;
+            default:
+                incRef(val);
+                res = val;
+                break;
         }
-        default:
-            incRef(val);
-            return val;
+        break;
     }
+    decRef(frame);
+    decRef(frame_func);
+    return res;
 }
 
 #define expandlist(list,parent) \
     for (NODE *expander = list, *last = NIL; expander; ) { \
-        if (expander->data && expander->data->type == ID_NODE) { \
+        if (expander->data && typeOf(expander->data) == ID_NODE) { \
             if (expander->data) { \
                 expander->data = macroexpand(asNODE(expander->data),scope,macros); \
                 if (!expander->data) { \
@@ -210,16 +700,150 @@ VALUE* evaluate(VALUE *val, NODE *scope) {
     (parent)->addr = (VALUE*)list;
     
 
+//one bit per symbol id, set once the symbol names a macro: most call heads
+//never do and skip the lookup in the macro map
+static uint8_t *macro_bits = NIL;
+static size_t macro_bits_len = 0;
+
+static void macro_mark(T_SYMBOL sym) {
+    if ((sym >> 3) >= macro_bits_len) {
+        size_t len = macro_bits_len ? macro_bits_len : 64;
+        while ((sym >> 3) >= len) len *= 2;
+        macro_bits = (uint8_t*)realloc(macro_bits,len);
+        failNIL(macro_bits,"Out of memory");
+        memset(macro_bits + macro_bits_len,0,len - macro_bits_len);
+        macro_bits_len = len;
+    }
+    macro_bits[sym >> 3] |= 1 << (sym & 7);
+}
+
+static inline bool macro_named(T_SYMBOL sym) {
+    return (sym >> 3) < macro_bits_len && (macro_bits[sym >> 3] & (1 << (sym & 7)));
+}
+
+//optional expansion cache, enabled by macro_cache: a macro call (arguments
+//already expanded) maps to a private copy of its expansion. calls are compared
+//structurally, so the same source expands once however often it is loaded.
+//a hit skips running the macro, so macros must not depend on side effects or
+//on globals that change between loads. redefining a macro differently clears it.
+bool macro_cache = false;
+
+typedef struct {
+    size_t hash;
+    VALUE *call; //NIL if the entry is empty
+    VALUE *expansion;
+} EXPANSION;
+
+static EXPANSION *expansions = NIL;
+static size_t expansions_len = 0, expansions_cap = 0, expansions_bytes = 0;
+
+//deep_copy fails on closures and frames
+static bool copyable(VALUE *val) {
+    for (; val && typeOf(val) == ID_NODE; val = ((NODE*)val)->addr) {
+        if (((NODE*)val)->datatype != DATA_NODE || !copyable(((NODE*)val)->data)) return false;
+    }
+    if (!val || isIMMEDIATE(val)) return true;
+    switch (val->type) {
+        case ID_SYMBOL:
+        case ID_INTEGER:
+        case ID_REAL:
+        case ID_STRING:
+        case ID_PRIMFUNC:
+            return true;
+    }
+    return false;
+}
+
+static EXPANSION* expansion_slot(VALUE *call, size_t hash) {
+    size_t i = hash & (expansions_cap - 1);
+    while (expansions[i].call && (expansions[i].hash != hash || !equalVALUE(expansions[i].call,call))) i = (i + 1) & (expansions_cap - 1);
+    return &expansions[i];
+}
+
+static void expansion_clear() {
+    for (size_t i = 0; i < expansions_cap; i++) {
+        decRef(expansions[i].call);
+        decRef(expansions[i].expansion);
+        expansions[i].call = expansions[i].expansion = NIL;
+    }
+    expansions_len = 0;
+}
+
+static void expansion_put(VALUE *call, size_t hash, VALUE *expansion) {
+    if (2*(expansions_len+1) > expansions_cap) {
+        EXPANSION *old = expansions;
+        size_t old_cap = expansions_cap;
+        if (!expansions_cap) gc_area((void**)&expansions,&expansions_bytes);
+        expansions_cap = expansions_cap ? expansions_cap*2 : 64;
+        expansions = (EXPANSION*)calloc(expansions_cap,sizeof(EXPANSION));
+        failNIL(expansions,"Out of memory");
+        expansions_bytes = expansions_cap*sizeof(EXPANSION);
+        for (size_t i = 0; i < old_cap; i++) {
+            if (old[i].call) *expansion_slot(old[i].call,old[i].hash) = old[i];
+        }
+        free(old);
+    }
+    EXPANSION *slot = expansion_slot(call,hash);
+    slot->hash = hash;
+    slot->call = call;
+    slot->expansion = expansion;
+    expansions_len++;
+}
+
+//runs macro on form, or reuses an earlier expansion of an equal form
+static VALUE* macro_call(NODE *macro, NODE *form, NODE *scope) {
+    if (!macro_cache || !copyable((VALUE*)form)) return call_function(macro->addr,asNODE(form->addr),scope);
+    size_t hash = hashVALUE((VALUE*)form);
+    if (expansions_len) {
+        EXPANSION *slot = expansion_slot((VALUE*)form,hash);
+        if (slot->call) {
+            debugVal(form,"cached expansion: ");
+            return deep_copy(slot->expansion);
+        }
+    }
+    VALUE *call = deep_copy((VALUE*)form); //the macro or later passes may modify form
+    VALUE *replace = call_function(macro->addr,asNODE(form->addr),scope);
+    if (copyable(replace)) {
+        expansion_put(call,hash,deep_copy(replace));
+    } else {
+        decRef(call);
+    }
+    return replace;
+}
+
+//lazy mode: LAMBDA bodies are marked FLAG_LAZY instead of expanded, and
+//lambda_expander runs the passes on one when it is first called. since a
+//defun body reaches the macro as an argument, macros see their arguments
+//unexpanded in this mode, and their expansion is expanded in turn.
+bool macro_lazy = false;
+void (*lambda_expander)(NODE *lambda) = NIL;
+
+//expands the body of a (vars . body) left alone in lazy mode
+void macroexpand_lambda(NODE *lambda, NODE *scope, NODE *macros) {
+    lambda->flags &= ~FLAG_LAZY;
+    NODE *body = asNODE(lambda->addr);
+    expandlist(body,lambda);
+}
+
 VALUE* macroexpand(NODE *form, NODE *scope, NODE *macros) {
     debugVal(form,"macroexpand: ");
     if (!form) return NIL;
+    if (isCONST(form) && !(form->data && typeOf(form->data) == ID_PRIMFUNC && ((PRIMFUNC*)form->data)->spec == SPEC_QUOTE)) {
+        NODE *copy = (NODE*)deep_copy((VALUE*)form); //expansion is destructive; never touch a shared constant
+        decRef(form);
+        form = copy;
+    }
     if (form->data) {
-        switch (form->data->type) {
+        switch (typeOf(form->data)) {
             case ID_PRIMFUNC: { //handle special form syntax
                 switch (((PRIMFUNC*)form->data)->spec) {
                     case SPEC_QUOTE:
                         return (VALUE*)form; //return unmodified form
                     case SPEC_LAMBDA: {
+                        if (macro_lazy && form->addr) {
+                            asNODE(form->addr)->flags |= FLAG_LAZY;
+                            return (VALUE*)form;
+                        }
                         NODE *body = asNODE(asNODE(form->addr)->addr);
                         expandlist(body,(NODE*)form->addr);
                         return (VALUE*)form; //return expanded form
@@ -239,6 +863,13 @@ VALUE* macroexpand(NODE *form, NODE *scope, NODE *macros) {
                         NODE *macro = newNODE(scope,args); 
                         debugVal(macro,"macro func: ");
                         macro->datatype = DATA_FUNCTION; 
+                        macro_mark(name->sym);
+                        if (expansions_len) {
+                            NODE *old = binmap_find(name,macros);
+                            NODE *prev = old ? (NODE*)old->addr : NIL;
+                            if (!prev || prev->data != macro->data || !equalVALUE(prev->addr,macro->addr)) expansion_clear();
+                            decRef(old);
+                        }
                         binmap_put(name,macro,macros);
                         return NIL; //emits no runtime code
                     }
@@ -251,15 +882,22 @@ VALUE* macroexpand(NODE *form, NODE *scope, NODE *macros) {
                 debug("detected possible macro\n");
                 NODE *args = asNODE(form->addr);
                 debugVal(args,"macro arguments: ");
-                expandlist(args,form);
+                if (!macro_lazy) {
+                    expandlist(args,form);
+                }
                 debugVal(args,"expanded macro arguments: ");
-                NODE *macro = binmap_find(form->data,macros);
+                NODE *macro = macro_named(((SYMBOL*)form->data)->sym) ? binmap_find(form->data,macros) : NIL;
                 if (macro) {
                     debugVal(form,"expanding: ");
-                    VALUE *replace = call_function(macro->addr,args,scope);
+                    VALUE *replace = macro_call(macro,form,scope);
+                    decRef(macro);
                     decRef(form); 
+                    if (macro_lazy && replace && typeOf(replace) == ID_NODE) replace = macroexpand((NODE*)replace,scope,macros);
                     return replace; //return replaced form
                 } else {
+                    if (macro_lazy) {
+                        expandlist(args,form);
+                    }
                     return (VALUE*)form; //return expanded form
                 }
             }
@@ -23,6 +23,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include "alloc.h"
 
 #define bool    int
 #define true    1
@@ -42,14 +44,15 @@
 
 #define as_type(_type) \
     static inline _type* as ## _type(void *val) { \
-        if (!val || ((VALUE*)val)->type != ID_ ## _type) error(#_type" expected"); \
+        if (!val || typeOf(val) != ID_ ## _type) error(#_type" expected"); \
         return (_type*)val; \
     }
     
 #define new_type(_type,_var) \
     static inline _type* new ## _type(T_ ## _type _ ## _var) { \
-        _type *val = (_type*)malloc(sizeof(_type));\
+        _type *val = (_type*)alloc_VALUE(ID_ ## _type,sizeof(_type));\
         val->type = ID_ ## _type; \
+        val->flags = 0; \
         val->refc = 1; \
         val->_var = _ ## _var; \
         return val; \
@@ -63,6 +66,7 @@
 #define def_type(_type,_var,_cmp_cond) \
     typedef struct { \
         T_TYPE type; \
+        T_TYPE flags; \
         size_t refc; \
         T_ ## _type _var; \
     } _type; \
@@ -76,9 +80,22 @@
 #define ID_REAL      0x03
 #define ID_STRING    0x04
 #define ID_PRIMFUNC  0x05
+#define ID_FRAME     0x06
+#define ID_LOCAL     0x07
+#define ID_CODE      0x08
+#define ID_ARGSPEC   0x09
+#define ID_VECTOR    0x0A
+#define ID_ARRAY     0x0B
+#define ID_HASH      0x0C
+#define ID_MEMO      0x0D
 
 #define NIL NULL
 
+//VALUE flags
+#define FLAG_CONST      0x01 //immutable (quoted constant), shared instead of copied
+#define FLAG_LAZY       0x02 //(vars . body) of a LAMBDA whose body is not expanded yet
+#define FLAG_INTERNED   0x04 //NODE made by hash_cons, the only one equal to it
+
 #define DATA_NODE       0x00
 #define DATA_FUNCTION   0x01
 #define DATA_SCOPE      0x02
@@ -92,48 +109,129 @@ typedef void* T_DATA;
 
 typedef struct {
     T_TYPE type;
+    T_TYPE flags;
     size_t refc;
 } VALUE;
 
-#ifdef GC_DEBUG
-    #define incRef(val) if (val) { \
-        if ((val)->type == -1) error("NOT REAL DATA"); \
-        /*debug("incref(%p):%u\n",(void*)val,((VALUE*)val)->refc);*/ \
-        ++(((VALUE*)val)->refc); \
-    }
-    #define decRef(val) if (val) { \
-        if ((val)->type == -1) error("DOUBLE FREE"); \
-        /*debug("decref(%p):%u\n",(void*)val,(int)((VALUE*)val)->refc);*/ \
-        if (--(((VALUE*)val)->refc) == 0) { \
-            debugVal(val,"free: "); \
-            (val)->type = -1; \
-            /*freeVALUE((VALUE*)val);*/ \
+//INTEGERs (and REALs with -DNAN_BOXING on 64-bit hosts) are immediates kept in
+//the VALUE pointer itself, so they are never allocated or reference counted.
+//fixnum: T_INTEGER zero-extended and shifted left one, low bit set
+//nanbox: IEEE bits offset by 2^48, so any word with upper 16 bits set is a REAL;
+//its low bit can be set too, so a fixnum also has its upper 16 bits clear
+
+#define FIXNUM_FITS(i) (UINTPTR_MAX > 0xFFFFFFFFu || ((i) >= -0x40000000 && (i) < 0x40000000))
+#ifdef NAN_BOXING
+    #if UINTPTR_MAX <= 0xFFFFFFFFu
+        #error "NAN_BOXING requires 64-bit pointers"
+    #endif
+    #define NANBOX_OFFSET (((uint64_t)1) << 48)
+    #define isNANBOX(val) ((((uintptr_t)(val)) >> 48) != 0)
+    #define isFIXNUM(val) ((((uintptr_t)(val)) & 1) && !isNANBOX(val))
+    #define isIMMEDIATE(val) ((((uintptr_t)(val)) & 1) || isNANBOX(val))
+#else
+    #define isNANBOX(val) false
+    #define isFIXNUM(val) (((uintptr_t)(val)) & 1)
+    #define isIMMEDIATE(val) isFIXNUM(val)
+#endif
+
+static inline T_TYPE typeOf(void *val) {
+    if (isFIXNUM(val)) return ID_INTEGER;
+    if (isNANBOX(val)) return ID_REAL;
+    return ((VALUE*)val)->type;
+}
+
+#if defined NO_REFC && !defined TRACING_GC
+    #define TRACING_GC
+#endif
+#if defined TRACING_GC && defined NO_SLAB
+    #error "TRACING_GC requires the slab allocator"
+#endif
+
+//the argument is evaluated exactly once, since callers pass expressions like decRef(evaluate(...))
+#ifdef NO_REFC
+    #define incRef(val) { (void)(val); }
+    #define decRef(val) { (void)(val); }
+#elif defined GC_DEBUG
+    #define incRef(val) { VALUE *_ref = (VALUE*)(val); if (_ref && !isIMMEDIATE(_ref)) { \
+        if (_ref->type == (T_TYPE)-1) error("NOT REAL DATA"); \
+        /*debug("incref(%p):%u\n",(void*)_ref,_ref->refc);*/ \
+        ++(_ref->refc); \
+    } }
+    #define decRef(val) { VALUE *_ref = (VALUE*)(val); if (_ref && !isIMMEDIATE(_ref)) { \
+        if (_ref->type == (T_TYPE)-1) error("DOUBLE FREE"); \
+        /*debug("decref(%p):%u\n",(void*)_ref,(int)_ref->refc);*/ \
+        if (--(_ref->refc) == 0) { \
+            debugVal(_ref,"free: "); \
+            _ref->type = -1; \
+            /*freeVALUE(_ref);*/ \
         } \
-    }
+    } }
 #else 
-    #define incRef(val) if (val) { ++(((VALUE*)val)->refc); }
-    #define decRef(val) if (val) { if (--(((VALUE*)val)->refc) == 0) { freeVALUE((VALUE*)val); } }
+    #define incRef(val) { VALUE *_ref = (VALUE*)(val); if (_ref && !isIMMEDIATE(_ref)) { ++(_ref->refc); } }
+    #define decRef(val) { VALUE *_ref = (VALUE*)(val); if (_ref && !isIMMEDIATE(_ref)) { if (--(_ref->refc) == 0) { freeVALUE(_ref); } } }
 #endif
 
 #define asVALUE(val) ((VALUE*)val)
+#define isCONST(val) (!(val) || isIMMEDIATE(val) || (((VALUE*)(val))->flags & FLAG_CONST))
 void freeVALUE(VALUE *val);
+void finalizeVALUE(VALUE *val);
 VALUE* deep_copy(VALUE *val);
+void constify(VALUE *val);
+size_t hashVALUE(VALUE *val);
+bool equalVALUE(VALUE *a, VALUE *b);
+
+//an explicit stack for walking nested data without recursing on the C stack;
+//it starts in local and moves to the heap if it outgrows it
+#define WALK_LOCAL      32
+
+typedef struct {
+    VALUE **vals;
+    size_t len, cap;
+    VALUE *local[WALK_LOCAL];
+} WALK;
+
+static inline void walk_init(WALK *walk) {
+    walk->vals = walk->local;
+    walk->len = 0;
+    walk->cap = WALK_LOCAL;
+}
+
+static inline void walk_push(WALK *walk, VALUE *val) {
+    if (walk->len == walk->cap) {
+        walk->cap *= 2;
+        if (walk->vals == walk->local) {
+            walk->vals = (VALUE**)malloc(walk->cap*sizeof(VALUE*));
+            failNIL(walk->vals,"Out of memory");
+            memcpy(walk->vals,walk->local,sizeof(walk->local));
+        } else {
+            walk->vals = (VALUE**)realloc(walk->vals,walk->cap*sizeof(VALUE*));
+            failNIL(walk->vals,"Out of memory");
+        }
+    }
+    walk->vals[walk->len++] = val;
+}
+
+static inline void walk_free(WALK *walk) {
+    if (walk->vals != walk->local) free(walk->vals);
+}
 
 typedef struct {
     T_TYPE type;
+    T_TYPE flags;
     size_t refc;
     T_TYPE datatype;
     VALUE *addr,*data;    
 } NODE;
 
 static inline NODE* asNODE(void *val) { 
-    if (val && ((VALUE*)val)->type != ID_NODE) error("NODE expected");
+    if (val && typeOf(val) != ID_NODE) error("NODE expected");
     return (NODE*)val;
 }
 
 static inline NODE* newNODE(void *data, void *addr) {
-    NODE *node = (NODE*)malloc(sizeof(NODE));
+    NODE *node = (NODE*)alloc_VALUE(ID_NODE,sizeof(NODE));
     node->type = ID_NODE;
+    node->flags = 0;
     node->refc = 1;
     node->datatype = DATA_NODE;
     node->data = (VALUE*)data;
@@ -142,23 +240,95 @@ static inline NODE* newNODE(void *data, void *addr) {
 }
 
 static inline int cmpNODE(NODE *a, NODE *b) {
-    return (size_t)a - (size_t)b;
+    return (a > b) - (a < b);
 }
 
 def_type(SYMBOL,sym,(int)a->sym - (int)b->sym)
-def_type(INTEGER,val,a->val - b->val)
-def_type(REAL,val,a->val - b->val)
 def_type(STRING,str,strcmp(a->str,b->str))
 
+//boxed forms, only used when an immediate cannot represent the value
+typedef struct {
+    T_TYPE type;
+    T_TYPE flags;
+    size_t refc;
+    T_INTEGER val;
+} INTEGER;
+
+typedef struct {
+    T_TYPE type;
+    T_TYPE flags;
+    size_t refc;
+    T_REAL val;
+} REAL;
+
+static inline VALUE* newINTEGER(T_INTEGER i) {
+    if (FIXNUM_FITS(i)) return (VALUE*)((((uintptr_t)(unsigned int)i) << 1) | 1);
+    INTEGER *val = (INTEGER*)alloc_VALUE(ID_INTEGER,sizeof(INTEGER));
+    val->type = ID_INTEGER;
+    val->flags = 0;
+    val->refc = 1;
+    val->val = i;
+    return (VALUE*)val;
+}
+
+static inline T_INTEGER asINTEGER(void *val) {
+    if (isFIXNUM(val)) {
+        if (UINTPTR_MAX > 0xFFFFFFFFu) return (T_INTEGER)(unsigned int)(((uintptr_t)val) >> 1);
+        return (T_INTEGER)(((intptr_t)val) >> 1);
+    }
+    if (!val || typeOf(val) != ID_INTEGER) error("INTEGER expected");
+    return ((INTEGER*)val)->val;
+}
+
+static inline VALUE* newREAL(T_REAL r) {
+#ifdef NAN_BOXING
+    union { T_REAL r; uint64_t u; } bits = { r };
+    if (r != r) bits.u = 0x7FF8000000000000ULL; //canonical NaN so the offset cannot wrap
+    return (VALUE*)(uintptr_t)(bits.u + NANBOX_OFFSET);
+#else
+    REAL *val = (REAL*)alloc_VALUE(ID_REAL,sizeof(REAL));
+    val->type = ID_REAL;
+    val->flags = 0;
+    val->refc = 1;
+    val->val = r;
+    return (VALUE*)val;
+#endif
+}
+
+static inline T_REAL asREAL(void *val) {
+#ifdef NAN_BOXING
+    if (isNANBOX(val)) {
+        union { uint64_t u; T_REAL r; } bits = { (uint64_t)(uintptr_t)val - NANBOX_OFFSET };
+        return bits.r;
+    }
+#endif
+    if (!val || typeOf(val) != ID_REAL) error("REAL expected");
+    return ((REAL*)val)->val;
+}
+
+//numeric value of an INTEGER or REAL as a REAL
+static inline T_REAL asNUMBER(void *val) {
+    failNIL(val,"NIL is not a number");
+    return typeOf(val) == ID_REAL ? asREAL(val) : (T_REAL)asINTEGER(val);
+}
+
 typedef VALUE* (*NATIVE_FUNC)(NODE *args, NODE *scope);
+typedef VALUE* (*ARGV_FUNC)(int argc, VALUE **argv, NODE *scope);
 
 typedef struct {
     T_TYPE type;
+    T_TYPE flags;
     size_t refc;
     T_TYPE spec; //handles how function arguments are treated by evaluate and macroexpand
-    NATIVE_FUNC native;  
+    T_TYPE abi; //how native takes its arguments
+    NATIVE_FUNC native; //an ARGV_FUNC under ABI_ARGV
 } PRIMFUNC;
 
+//native takes the arguments as a list
+#define ABI_LIST        0
+//native is an ARGV_FUNC borrowing argc values at argv (SPEC_FUNC only)
+#define ABI_ARGV        1
+
 //for macroexpand all arguments and evaluate all arguments
 #define SPEC_FUNC       0
 //for macroexpand all arguments and quote all arguments
@@ -171,49 +341,302 @@ typedef struct {
 #define SPEC_MACRODEF   4
 
 static inline PRIMFUNC* asPRIMFUNC(void *val) { 
-    if (val && ((PRIMFUNC*)val)->type != ID_PRIMFUNC) error("PRIMFUNC expected");
+    if (val && typeOf(val) != ID_PRIMFUNC) error("PRIMFUNC expected");
     return (PRIMFUNC*)val;
 }
 
-static inline PRIMFUNC* newPRIMFUNC(T_TYPE spec, NATIVE_FUNC native) {
-    PRIMFUNC *primfunc = (PRIMFUNC*)malloc(sizeof(PRIMFUNC));
+static inline PRIMFUNC* newPRIMFUNC(T_TYPE spec, T_TYPE abi, NATIVE_FUNC native) {
+    PRIMFUNC *primfunc = (PRIMFUNC*)alloc_VALUE(ID_PRIMFUNC,sizeof(PRIMFUNC));
     primfunc->type = ID_PRIMFUNC;
+    primfunc->flags = 0;
     primfunc->refc = 1;
     primfunc->spec = spec;
+    primfunc->abi = abi;
     primfunc->native = native;
     return primfunc;
 }
 
 static inline int cmpPRIMFUNC(PRIMFUNC *a, PRIMFUNC *b) {
-    return (size_t)a->native - (size_t)b->native;
+    uintptr_t na = (uintptr_t)a->native, nb = (uintptr_t)b->native;
+    return (na > nb) - (na < nb);
+}
+
+//a lambda list compiled by scope_argspec, which swaps it in for the list in the
+//function's (vars . body) the first time it is called or closed over: slot i
+//binds syms[i]; the first required slots must be filled, the next optional ones
+//default to NIL, and a rest slot after them takes the remaining arguments
+#define ARGS_EVAL       0
+#define ARGS_QUOTED     1 //((a b)): arguments are bound unevaluated
+//
+//resolve marks a LAMBDA closed when nothing in it can look variables up by
+//name. its closures then keep a frame of just the variables it uses from
+//enclosing functions, copied from (depth, slot) of the creating scope or, if
+//they may change later, sharing the boxed slot, over the global scope.
+
+typedef struct {
+    unsigned short depth, slot;
+    T_SYMBOL sym;
+    bool box;
+} CAPTURE;
+
+typedef struct ARGSPEC {
+    T_TYPE type;
+    T_TYPE flags;
+    size_t refc;
+    VALUE *vars; //the lambda list as written
+    unsigned short size, required, optional;
+    bool rest;
+    T_TYPE mode;
+    T_SYMBOL *syms;
+    bool closed;
+    bool loop; //a DOTIMES or DOLIST variable: BIND of other names passes through
+    unsigned short ncaptures;
+    CAPTURE *captures;
+    struct ARGSPEC *env; //names the slots of a closure's captured frame
+} ARGSPEC;
+
+//the lambda list as written, whether or not it has been compiled
+static inline VALUE* lambda_written(VALUE *vars) {
+    return vars && typeOf(vars) == ID_ARGSPEC ? ((ARGSPEC*)vars)->vars : vars;
+}
+
+//a function call's bindings: the arguments sit inline in slots, in the order of
+//the lambda list vars; anything else BIND puts into a scope lands in map. a slot
+//is boxed into a (sym . val) entry once REF hands that entry out, so SETA on
+//it stays visible to LOCAL refs
+#define FRAME_INLINE    4
+#define FRAME_BOXBITS   64
+
+typedef struct {
+    T_TYPE type;
+    T_TYPE flags;
+    size_t refc;
+    NODE *map;
+    ARGSPEC *spec;
+    size_t size;
+    uint64_t boxed; //bit per slot, slots past FRAME_BOXBITS are always boxed
+    VALUE **slots; //inline_slots unless size > FRAME_INLINE
+    VALUE *inline_slots[FRAME_INLINE];
+} FRAME;
+
+#define frame_boxed(frame,slot) ((slot) >= FRAME_BOXBITS || (((frame)->boxed >> (slot)) & 1))
+
+static inline FRAME* asFRAME(void *val) { 
+    if (!val || typeOf(val) != ID_FRAME) error("FRAME expected");
+    return (FRAME*)val;
+}
+
+//takes a reference to spec
+static inline FRAME* newFRAME(ARGSPEC *spec, size_t size) {
+    FRAME *frame = (FRAME*)alloc_VALUE(ID_FRAME,sizeof(FRAME));
+    frame->type = ID_FRAME;
+    frame->flags = 0;
+    frame->refc = 1;
+    frame->map = NIL;
+    frame->spec = spec;
+    frame->size = size;
+    frame->boxed = 0;
+    frame->slots = size > FRAME_INLINE ? (VALUE**)malloc(size*sizeof(VALUE*)) : frame->inline_slots;
+    memset(frame->slots,0,size*sizeof(VALUE*));
+    return frame;
+}
+
+//a variable reference resolved to the slot-th argument of the frame depth scopes up
+typedef struct {
+    T_TYPE type;
+    T_TYPE flags;
+    size_t refc;
+    T_SYMBOL sym;
+    unsigned short depth,slot;
+} LOCAL;
+
+static inline LOCAL* newLOCAL(T_SYMBOL sym, size_t depth, size_t slot) {
+    LOCAL *local = (LOCAL*)alloc_VALUE(ID_LOCAL,sizeof(LOCAL));
+    local->type = ID_LOCAL;
+    local->flags = FLAG_CONST;
+    local->refc = 1;
+    local->sym = sym;
+    local->depth = depth;
+    local->slot = slot;
+    return local;
+}
+
+static inline int cmpLOCAL(LOCAL *a, LOCAL *b) {
+    return (int)a->sym - (int)b->sym;
+}
+
+//a compiled form; evaluating it runs the bytecode VM (see bytecode.h)
+typedef struct {
+    T_TYPE type;
+    T_TYPE flags;
+    size_t refc;
+    int *ops;
+    size_t len;
+    VALUE **consts;
+    size_t nconsts;
+    size_t depth; //most values the code keeps on the VM stack
+} CODE;
+
+//a fixed length run of unboxed numbers, all INTEGER or all REAL; see vector.h
+#define VEC_INTEGER     0
+#define VEC_REAL        1
+
+typedef struct {
+    T_TYPE type;
+    T_TYPE flags;
+    size_t refc;
+    T_TYPE elem;
+    size_t len;
+    void *data; //T_INTEGERs or T_REALs, aligned for the SIMD kernels
+} VECTOR;
+
+#define vec_ints(vec) ((T_INTEGER*)(vec)->data)
+#define vec_reals(vec) ((T_REAL*)(vec)->data)
+
+static inline VECTOR* asVECTOR(void *val) {
+    if (!val || typeOf(val) != ID_VECTOR) error("VECTOR expected");
+    return (VECTOR*)val;
+}
+
+//a growable run of any VALUEs, held contiguously: AREF and ASET are O(1) and
+//PUSH doubles the storage when it is full
+typedef struct {
+    T_TYPE type;
+    T_TYPE flags;
+    size_t refc;
+    size_t len, cap;
+    VALUE **items;
+} ARRAY;
+
+static inline ARRAY* asARRAY(void *val) {
+    if (!val || typeOf(val) != ID_ARRAY) error("ARRAY expected");
+    return (ARRAY*)val;
+}
+
+//len NIL elements
+static inline ARRAY* newARRAY(size_t len) {
+    ARRAY *arr = (ARRAY*)alloc_VALUE(ID_ARRAY,sizeof(ARRAY));
+    arr->type = ID_ARRAY;
+    arr->flags = 0;
+    arr->refc = 1;
+    arr->len = arr->cap = len;
+    arr->items = (VALUE**)calloc(len ? len : 1,sizeof(VALUE*));
+    failNIL(arr->items,"Out of memory");
+    return arr;
+}
+
+//appends val, taking the reference to it
+static inline void array_push(ARRAY *arr, VALUE *val) {
+    if (arr->len == arr->cap) {
+        arr->cap = arr->cap ? arr->cap*2 : 4;
+        arr->items = (VALUE**)realloc(arr->items,arr->cap*sizeof(VALUE*));
+        failNIL(arr->items,"Out of memory");
+    }
+    arr->items[arr->len++] = val;
+}
+
+static inline int cmpARRAY(ARRAY *a, ARRAY *b) {
+    return (a > b) - (a < b);
+}
+
+//an open addressing hash table; see hash.h
+typedef struct {
+    VALUE *key, *val; //key NIL: never used, HASH_TOMB: removed
+    size_t hash;
+} HASHSLOT;
+
+typedef struct {
+    HASHSLOT *slots;
+    size_t cap, used; //used counts removed slots too
+} HASHTABLE;
+
+typedef struct {
+    T_TYPE type;
+    T_TYPE flags;
+    size_t refc;
+    size_t count;
+    HASHTABLE cur;
+    HASHTABLE old; //still being moved into cur, from slot moved on
+    size_t moved, step; //step old slots move with each operation
+} HASH;
+
+extern VALUE hash_tomb;
+#define HASH_TOMB (&hash_tomb)
+
+static inline HASH* asHASH(void *val) {
+    if (!val || typeOf(val) != ID_HASH) error("HASH expected");
+    return (HASH*)val;
+}
+
+//a function wrapped with a bounded cache of its results; see memo.h
+typedef struct MEMOENTRY MEMOENTRY;
+
+typedef struct {
+    T_TYPE type;
+    T_TYPE flags;
+    size_t refc;
+    VALUE *func;
+    MEMOENTRY **buckets;
+    size_t cap, count;
+    size_t limit; //0: unbounded
+    MEMOENTRY *newest, *oldest; //most recently used first
+    size_t hits, misses, evictions;
+} MEMO;
+
+static inline MEMO* asMEMO(void *val) {
+    if (!val || typeOf(val) != ID_MEMO) error("MEMO expected");
+    return (MEMO*)val;
 }
 
 static inline int cmpVALUE(void *_a, void *_b) {
     VALUE *a = asVALUE(_a);
     VALUE *b = asVALUE(_b);
-    if (a && b && a->type == b->type) {
-        switch (a->type) {
+    if (a && b && typeOf(a) == typeOf(b)) {
+        switch (typeOf(a)) {
             case ID_NODE:
                 return cmpNODE((NODE*)a,(NODE*)b);
             case ID_SYMBOL:
                 return cmpSYMBOL((SYMBOL*)a,(SYMBOL*)b);
-            case ID_INTEGER:
-                return cmpINTEGER((INTEGER*)a,(INTEGER*)b);
-            case ID_REAL:
-                return cmpREAL((REAL*)a,(REAL*)b);
+            case ID_INTEGER: {
+                T_INTEGER ia = asINTEGER(a), ib = asINTEGER(b);
+                return (ia > ib) - (ia < ib);
+            }
+            case ID_REAL: {
+                T_REAL ra = asREAL(a), rb = asREAL(b);
+                return (ra > rb) - (ra < rb);
+            }
             case ID_STRING:
                 return cmpSTRING((STRING*)a,(STRING*)b);
             case ID_PRIMFUNC:
                 return cmpPRIMFUNC((PRIMFUNC*)a,(PRIMFUNC*)b);
+            case ID_LOCAL:
+                return cmpLOCAL((LOCAL*)a,(LOCAL*)b);
+            case ID_ARRAY:
+                return cmpARRAY((ARRAY*)a,(ARRAY*)b);
         }
+        return (a > b) - (a < b); //VECTORs, HASHes and the like only by identity
     }
     if (a && b) 
-        error("Cannot compare dissimilar types %u %u\n",a->type,b->type);
+        error("Cannot compare dissimilar types %u %u\n",typeOf(a),typeOf(b));
     error("Cannot compare NIL");
 }
 
+extern bool macro_cache;
+extern bool macro_lazy;
+extern void (*lambda_expander)(NODE *lambda);
 VALUE* macroexpand(NODE *form, NODE *scope, NODE *macros);
+void macroexpand_lambda(NODE *lambda, NODE *scope, NODE *macros);
+
+//readies a closure's (vars . body) before its body is run
+static inline void lambda_force(NODE *lambda) {
+    if (lambda && (lambda->flags & FLAG_LAZY)) lambda_expander(lambda);
+}
 VALUE* evaluate(VALUE *val, NODE *scope);
+VALUE* call_function(VALUE *func, NODE *args, NODE *scope);
+VALUE* call_prim(PRIMFUNC *prim, int argc, VALUE **argv, NODE *scope);
+VALUE* apply_values(VALUE *func, int argc, VALUE **argv, NODE *scope);
+VALUE** args_reserve(int argc);
+void args_release(VALUE **argv, int argc);
 void print(VALUE *val);
 
 #endif
@@ -41,10 +41,13 @@ static inline NODE* list_join(NODE *a, NODE *b) {
 }
 
 static inline NODE* list_reverseInPlace(NODE *list, NODE *tail) {
-    if (!list) return tail;
-    NODE* next = asNODE(list->addr);
-    list->addr = asVALUE(tail);
-    return list_reverseInPlace(next, list);
+    while (list) {
+        NODE* next = asNODE(list->addr);
+        list->addr = asVALUE(tail);
+        tail = list;
+        list = next;
+    }
+    return tail;
 }
 
 static inline void list_push(void *val, NODE **list) {
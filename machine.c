@@ -0,0 +1,311 @@
+/**
+ *  Copyright 2013 by Benjamin J. Land (a.k.a. BenLand100)
+ *
+ *  This file is part of L, a virtual machine for a lisp-like language.
+ *
+ *  L is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  L is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with L. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "machine.h"
+#include "primitives.h"
+#include "scope.h"
+#include "resolve.h"
+#include "bytecode.h"
+#include "gc.h"
+#include "listops.h"
+#include "memo.h"
+
+#define K_HEAD  0 //head being evaluated; forms are the arguments
+#define K_ARGS  1 //argument being evaluated; forms are the ones after it
+#define K_COND  2 //test of the first of forms being evaluated
+#define K_PROG  3 //form being evaluated; forms are the ones after it
+#define K_BODY  4 //as K_PROG in a function's frame, which it owns with func;
+                  //once forms is NIL it only waits to release them
+#define K_MEMO  5 //call of a MEMO's LAMBDA running; func is the MEMO, whose
+                  //result is cached for the values in argv
+
+typedef struct {
+    int kind;
+    NODE *scope;
+    NODE *forms;
+    VALUE *func;
+    NODE *list, *last; //K_ARGS: the values so far
+    VALUE **argv; //K_ARGS to an ABI_ARGV primitive or a MEMO: the values go here instead
+    int argc, argi;
+} KONT;
+
+size_t machine_limit = MACHINE_LIMIT;
+
+static KONT *konts = NIL;
+static size_t konts_len = 0, konts_cap = 0, konts_bytes = 0;
+
+//the returned KONT is only valid until the next push
+static KONT* push(int kind, NODE *scope, NODE *forms) {
+    if (machine_limit && konts_len >= machine_limit) error("Stack exhausted: %u nested evaluations",(unsigned int)konts_len);
+    if (konts_len == konts_cap) {
+        if (!konts) gc_area((void**)&konts,&konts_bytes);
+        konts_cap = konts_cap ? konts_cap*2 : 256;
+        if (machine_limit && konts_cap > machine_limit) konts_cap = machine_limit;
+        konts = (KONT*)realloc(konts,konts_cap*sizeof(KONT));
+        failNIL(konts,"Out of memory");
+        konts_bytes = konts_cap*sizeof(KONT);
+    }
+    KONT *k = &konts[konts_len++];
+    k->kind = kind;
+    k->scope = scope;
+    k->forms = forms;
+    k->func = NIL;
+    k->list = k->last = NIL;
+    k->argv = NIL;
+    return k;
+}
+
+//calls memo on the argc values in argv, taking the reference to memo and the
+//values; a miss on a LAMBDA leaves a K_MEMO holding them and returns true with
+//func and list set up to apply it, anything else returns false with acc set
+static bool memo_enter(MEMO *memo, int argc, VALUE **argv, NODE *scope, VALUE **acc, VALUE **func, NODE **list) {
+    bool found;
+    *acc = memo_lookup(memo,argc,argv,&found);
+    if (!found && typeOf(memo->func) == ID_NODE) {
+        KONT *k = push(K_MEMO,scope,NIL);
+        k->func = (VALUE*)memo;
+        k->argv = argv;
+        k->argc = argc;
+        *list = NIL;
+        for (int i = argc; i--;) {
+            incRef(argv[i]);
+            *list = newNODE(argv[i],*list);
+        }
+        incRef(memo->func);
+        *func = memo->func;
+        return true;
+    }
+    if (!found) {
+        *acc = apply_values(memo->func,argc,argv,scope);
+        memo_store(memo,argc,argv,*acc);
+    }
+    if (argc) args_release(argv,argc);
+    decRef(memo);
+    return false;
+}
+
+//starts a clause of a COND, or returns false if there are none left
+static bool cond_test(NODE *clauses, VALUE **val) {
+    if (!clauses) return false;
+    NODE *test = asNODE(clauses->data);
+    if (!test || !test->addr || asNODE(test->addr)->addr) error("Malformed conditional");
+    *val = test->data;
+    return true;
+}
+
+VALUE* machine_eval(VALUE *val, NODE *scope) {
+    size_t base = konts_len;
+    VALUE *acc = NIL;
+    bool eval = true;
+    for (;;) {
+        if (eval) {
+            gc_poll();
+            eval = false;
+            if (!val) {
+                acc = NIL;
+                continue;
+            }
+            switch (typeOf(val)) {
+                case ID_NODE:
+                    push(K_HEAD,scope,asNODE(((NODE*)val)->addr));
+                    val = ((NODE*)val)->data;
+                    eval = true;
+                    continue;
+                case ID_SYMBOL:
+                    acc = scope_resolve((SYMBOL*)val,scope);
+                    continue;
+                case ID_LOCAL:
+                    acc = scope_local((LOCAL*)val,scope);
+                    continue;
+                case ID_CODE:
+                    acc = vm_run((CODE*)val,scope);
+                    continue;
+                default:
+                    incRef(val);
+                    acc = val;
+                    continue;
+            }
+        }
+        if (konts_len == base) return acc;
+        KONT *k = &konts[konts_len-1];
+        VALUE *func = NIL;
+        NODE *list = NIL;
+        switch (k->kind) {
+            case K_HEAD: {
+                func = acc;
+                list = k->forms;
+                scope = k->scope;
+                konts_len--;
+                failNIL(func,"NIL cannot be invoked");
+                if (typeOf(func) == ID_PRIMFUNC) {
+                    PRIMFUNC *prim = (PRIMFUNC*)func;
+                    if (prim->native == (NATIVE_FUNC)l_cond) {
+                        decRef(func);
+                        acc = NIL;
+                        if ((eval = cond_test(list,&val))) push(K_COND,scope,list);
+                        continue;
+                    } else if (prim->native == (NATIVE_FUNC)l_prog) {
+                        decRef(func);
+                        acc = NIL;
+                        if (!list) continue;
+                        if (list->addr) push(K_PROG,scope,asNODE(list->addr));
+                        val = list->data;
+                        eval = true;
+                        continue;
+                    } else if (loop_run(prim,list,scope,machine_eval,&acc)) {
+                        decRef(func);
+                        continue;
+                    } else if (prim->spec && prim->native != (NATIVE_FUNC)l_list) {
+                        acc = prim->native(list,scope);
+                        decRef(func);
+                        continue;
+                    }
+                } else if (typeOf(func) == ID_NODE) {
+                    if (scope_argspec(asNODE(((NODE*)func)->addr))->mode == ARGS_QUOTED) {
+                        list = (NODE*)resolve_strip((VALUE*)list); //quote args as written, not as resolved
+                        break;
+                    }
+                } else if (typeOf(func) != ID_MEMO) {
+                    error("Malfored function invoke");
+                }
+                if (list) {
+                    k = push(K_ARGS,scope,asNODE(list->addr));
+                    k->func = func;
+                    if (typeOf(func) == ID_MEMO || (typeOf(func) == ID_PRIMFUNC && ((PRIMFUNC*)func)->abi == ABI_ARGV)) {
+                        k->argc = list_length(list);
+                        k->argi = 0;
+                        k->argv = args_reserve(k->argc);
+                    }
+                    val = list->data;
+                    eval = true;
+                    continue;
+                }
+                break;
+            }
+            case K_ARGS: {
+                if (k->argv) {
+                    k->argv[k->argi++] = acc;
+                } else {
+                    NODE *cell = newNODE(acc,NIL);
+                    if (k->last) k->last->addr = (VALUE*)cell; else k->list = cell;
+                    k->last = cell;
+                }
+                if (k->forms) {
+                    val = k->forms->data;
+                    scope = k->scope;
+                    k->forms = asNODE(k->forms->addr);
+                    eval = true;
+                    continue;
+                }
+                func = k->func;
+                list = k->list;
+                scope = k->scope;
+                konts_len--;
+                if (k->argv) {
+                    VALUE **argv = k->argv; //k may move while the call runs
+                    int argc = k->argc;
+                    if (typeOf(func) == ID_MEMO) {
+                        if (memo_enter((MEMO*)func,argc,argv,scope,&acc,&func,&list)) break;
+                        continue;
+                    }
+                    acc = ((ARGV_FUNC)((PRIMFUNC*)func)->native)(argc,argv,scope);
+                    args_release(argv,argc);
+                    decRef(func);
+                    continue;
+                }
+                break;
+            }
+            case K_COND:
+                scope = k->scope;
+                if (acc) {
+                    decRef(acc);
+                    val = asNODE(asNODE(k->forms->data)->addr)->data;
+                    konts_len--;
+                    eval = true;
+                } else if ((eval = cond_test(k->forms = asNODE(k->forms->addr),&val))) {
+                    acc = NIL;
+                } else {
+                    konts_len--;
+                }
+                continue;
+            case K_PROG:
+            case K_BODY:
+                if (!k->forms) { //K_BODY done
+                    decRef(k->scope);
+                    decRef(k->func);
+                    konts_len--;
+                    continue;
+                }
+                decRef(acc);
+                val = k->forms->data;
+                scope = k->scope;
+                k->forms = asNODE(k->forms->addr);
+                if (!k->forms && k->kind == K_PROG) konts_len--;
+                eval = true;
+                continue;
+            case K_MEMO:
+                memo_store((MEMO*)k->func,k->argc,k->argv,acc);
+                if (k->argc) args_release(k->argv,k->argc);
+                decRef(k->func);
+                konts_len--;
+                continue;
+        }
+        //apply func to the argument values in list, both references taken
+        if (typeOf(func) == ID_MEMO && !memo_enter((MEMO*)func,0,NIL,scope,&acc,&func,&list)) continue; //no arguments
+        if (typeOf(func) == ID_PRIMFUNC) {
+            if (((PRIMFUNC*)func)->native == (NATIVE_FUNC)l_list) {
+                acc = (VALUE*)list;
+            } else if (((PRIMFUNC*)func)->abi == ABI_ARGV) { //no arguments
+                acc = ((ARGV_FUNC)((PRIMFUNC*)func)->native)(0,NIL,scope);
+            } else {
+                acc = ((PRIMFUNC*)func)->native(list,scope);
+                decRef(list);
+            }
+            decRef(func);
+            continue;
+        }
+        NODE *lambda = asNODE(((NODE*)func)->addr);
+        lambda_force(lambda);
+        ARGSPEC *spec = scope_argspec(lambda);
+        NODE *fn_scope = scope_pushFrame(asNODE(((NODE*)func)->data),spec);
+        scope_bindArgs(spec,list,fn_scope);
+        decRef(list);
+        NODE *body = asNODE(lambda->addr);
+        if (!body) {
+            scope_pop(fn_scope);
+            decRef(func);
+            acc = NIL;
+            continue;
+        }
+        //a call in tail position takes over the finished K_BODY beneath it
+        if (konts_len > base && konts[konts_len-1].kind == K_BODY && !konts[konts_len-1].forms) {
+            k = &konts[konts_len-1];
+            decRef(k->scope);
+            decRef(k->func);
+            k->scope = fn_scope;
+        } else {
+            k = push(K_BODY,fn_scope,NIL);
+        }
+        k->func = func;
+        k->forms = asNODE(body->addr);
+        val = body->data;
+        scope = fn_scope;
+        eval = true;
+    }
+}
@@ -0,0 +1,38 @@
+/**
+ *  Copyright 2013 by Benjamin J. Land (a.k.a. BenLand100)
+ *
+ *  This file is part of L, a virtual machine for a lisp-like language.
+ *
+ *  L is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  L is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with L. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MACHINE
+#define _MACHINE
+
+#include "lisp.h"
+
+//an evaluator that keeps its continuations on a heap stack instead of the C
+//stack, so nesting is bounded by machine_limit rather than the thread's stack.
+//it handles calls, COND, PROG and LIST itself and goes no deeper in C than a
+//primitive; going past machine_limit (0 for none) is a "Stack exhausted" error.
+//printing, copying, hashing and comparing data walk explicit stacks as well, so
+//deeply nested data needs no C stack either.
+
+#define MACHINE_LIMIT   (1<<22)
+
+extern size_t machine_limit;
+
+VALUE* machine_eval(VALUE *form, NODE *scope);
+
+#endif
@@ -0,0 +1,205 @@
+/**
+ *  Copyright 2013 by Benjamin J. Land (a.k.a. BenLand100)
+ *
+ *  This file is part of L, a virtual machine for a lisp-like language.
+ *
+ *  L is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  L is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with L. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "memo.h"
+
+#define MEMO_MIN        16
+
+//one cached call: the argument values it was made with and its result
+struct MEMOENTRY {
+    MEMOENTRY *next; //in its bucket
+    MEMOENTRY *newer, *older;
+    size_t hash;
+    VALUE *val;
+    int argc;
+    VALUE *argv[];
+};
+
+static size_t memo_hash(int argc, VALUE **argv) {
+    size_t h = (size_t)argc;
+    for (int i = 0; i < argc; i++) h = (h ^ hashVALUE(argv[i])) * (size_t)1099511628211ULL;
+    return h ^ (h >> 29);
+}
+
+static MEMOENTRY** memo_find(MEMO *memo, int argc, VALUE **argv, size_t hash) {
+    MEMOENTRY **link = &memo->buckets[hash & (memo->cap-1)];
+    for (; *link; link = &(*link)->next) {
+        MEMOENTRY *entry = *link;
+        if (entry->hash != hash || entry->argc != argc) continue;
+        int i = 0;
+        while (i < argc && equalVALUE(entry->argv[i],argv[i])) i++;
+        if (i == argc) return link;
+    }
+    return link;
+}
+
+static void memo_unlink(MEMO *memo, MEMOENTRY *entry) {
+    if (entry->newer) entry->newer->older = entry->older; else memo->newest = entry->older;
+    if (entry->older) entry->older->newer = entry->newer; else memo->oldest = entry->newer;
+}
+
+static void memo_touch(MEMO *memo, MEMOENTRY *entry) {
+    entry->newer = NIL;
+    entry->older = memo->newest;
+    if (memo->newest) memo->newest->newer = entry; else memo->oldest = entry;
+    memo->newest = entry;
+}
+
+//unlinks the entry at *link and drops its references
+static void memo_drop(MEMO *memo, MEMOENTRY **link) {
+    MEMOENTRY *entry = *link;
+    *link = entry->next;
+    memo_unlink(memo,entry);
+    memo->count--;
+    for (int i = 0; i < entry->argc; i++) decRef(entry->argv[i]);
+    decRef(entry->val);
+    free(entry);
+}
+
+static void memo_evict(MEMO *memo) {
+    while (memo->limit && memo->count > memo->limit) {
+        MEMOENTRY *victim = memo->oldest;
+        MEMOENTRY **link = &memo->buckets[victim->hash & (memo->cap-1)];
+        while (*link != victim) link = &(*link)->next;
+        memo_drop(memo,link);
+        memo->evictions++;
+    }
+}
+
+static void memo_grow(MEMO *memo) {
+    size_t cap = memo->cap*2;
+    MEMOENTRY **buckets = (MEMOENTRY**)calloc(cap,sizeof(MEMOENTRY*));
+    failNIL(buckets,"Out of memory");
+    for (size_t i = 0; i < memo->cap; i++) {
+        for (MEMOENTRY *entry = memo->buckets[i], *next; entry; entry = next) {
+            next = entry->next;
+            entry->next = buckets[entry->hash & (cap-1)];
+            buckets[entry->hash & (cap-1)] = entry;
+        }
+    }
+    free(memo->buckets);
+    memo->buckets = buckets;
+    memo->cap = cap;
+}
+
+MEMO* newMEMO(VALUE *func, size_t limit) {
+    MEMO *memo = (MEMO*)alloc_VALUE(ID_MEMO,sizeof(MEMO));
+    memo->type = ID_MEMO;
+    memo->flags = 0;
+    memo->refc = 1;
+    incRef(func);
+    memo->func = func;
+    memo->buckets = (MEMOENTRY**)calloc(MEMO_MIN,sizeof(MEMOENTRY*));
+    failNIL(memo->buckets,"Out of memory");
+    memo->cap = MEMO_MIN;
+    memo->count = 0;
+    memo->limit = limit;
+    memo->newest = memo->oldest = NIL;
+    memo->hits = memo->misses = memo->evictions = 0;
+    return memo;
+}
+
+//the result cached for these arguments, counted as a hit, or NIL with *found
+//false, counted as a miss
+VALUE* memo_lookup(MEMO *memo, int argc, VALUE **argv, bool *found) {
+    MEMOENTRY *entry = *memo_find(memo,argc,argv,memo_hash(argc,argv));
+    *found = entry != NIL;
+    if (!entry) {
+        memo->misses++;
+        return NIL;
+    }
+    memo->hits++;
+    memo_unlink(memo,entry);
+    memo_touch(memo,entry);
+    incRef(entry->val);
+    return entry->val;
+}
+
+//caches res for these arguments, replacing anything cached for them while the
+//function ran; borrows the arguments and res
+void memo_store(MEMO *memo, int argc, VALUE **argv, VALUE *res) {
+    size_t hash = memo_hash(argc,argv);
+    MEMOENTRY **link = memo_find(memo,argc,argv,hash);
+    if (*link) memo_drop(memo,link);
+    MEMOENTRY *entry = (MEMOENTRY*)malloc(sizeof(MEMOENTRY) + argc*sizeof(VALUE*));
+    failNIL(entry,"Out of memory");
+    entry->hash = hash;
+    entry->argc = argc;
+    for (int i = 0; i < argc; i++) {
+        incRef(argv[i]);
+        entry->argv[i] = argv[i];
+    }
+    incRef(res);
+    entry->val = res;
+    if (memo->count >= memo->cap) memo_grow(memo);
+    entry->next = memo->buckets[hash & (memo->cap-1)];
+    memo->buckets[hash & (memo->cap-1)] = entry;
+    memo_touch(memo,entry);
+    memo->count++;
+    memo_evict(memo);
+}
+
+//borrows the argument values; the function may call memo again, so nothing
+//found before it runs is used after
+VALUE* memo_call(MEMO *memo, int argc, VALUE **argv, NODE *scope) {
+    bool found;
+    VALUE *res = memo_lookup(memo,argc,argv,&found);
+    if (found) return res;
+    res = apply_values(memo->func,argc,argv,scope);
+    memo_store(memo,argc,argv,res);
+    return res;
+}
+
+//drops the result cached for these arguments, if any
+bool memo_forget(MEMO *memo, int argc, VALUE **argv) {
+    MEMOENTRY **link = memo_find(memo,argc,argv,memo_hash(argc,argv));
+    if (!*link) return false;
+    memo_drop(memo,link);
+    return true;
+}
+
+void memo_clear(MEMO *memo) {
+    for (size_t i = 0; i < memo->cap; i++) {
+        while (memo->buckets[i]) memo_drop(memo,&memo->buckets[i]);
+    }
+}
+
+void memo_setLimit(MEMO *memo, size_t limit) {
+    memo->limit = limit;
+    memo_evict(memo);
+}
+
+//applies fn to each counted reference memo holds
+void memo_children(MEMO *memo, void (*fn)(VALUE*)) {
+    fn(memo->func);
+    for (MEMOENTRY *entry = memo->newest; entry; entry = entry->older) {
+        for (int i = 0; i < entry->argc; i++) fn(entry->argv[i]);
+        fn(entry->val);
+    }
+}
+
+//frees the entries without touching their references, which memo_children
+//has already released
+void memo_finalize(MEMO *memo) {
+    for (MEMOENTRY *entry = memo->newest, *older; entry; entry = older) {
+        older = entry->older;
+        free(entry);
+    }
+    free(memo->buckets);
+}
@@ -0,0 +1,45 @@
+/**
+ *  Copyright 2013 by Benjamin J. Land (a.k.a. BenLand100)
+ *
+ *  This file is part of L, a virtual machine for a lisp-like language.
+ *
+ *  L is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  L is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with L. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MEMO
+#define _MEMO
+
+#include "lisp.h"
+
+//memoized functions: a MEMO is called like the function it wraps, but first
+//looks its argument values up in a cache keyed on their structural hashes, so
+//arguments EQUAL to an earlier call's return that call's result without
+//running the function. the cache holds at most limit results and evicts the
+//least recently used one past that. arguments are compared when looked up, so
+//a list modified in place after a call no longer finds that call's result;
+//only pure functions of immutable arguments should be memoized.
+
+#define MEMO_LIMIT      1024
+
+MEMO* newMEMO(VALUE *func, size_t limit);
+VALUE* memo_lookup(MEMO *memo, int argc, VALUE **argv, bool *found);
+void memo_store(MEMO *memo, int argc, VALUE **argv, VALUE *res);
+VALUE* memo_call(MEMO *memo, int argc, VALUE **argv, NODE *scope);
+bool memo_forget(MEMO *memo, int argc, VALUE **argv);
+void memo_clear(MEMO *memo);
+void memo_setLimit(MEMO *memo, size_t limit);
+void memo_children(MEMO *memo, void (*fn)(VALUE*));
+void memo_finalize(MEMO *memo);
+
+#endif
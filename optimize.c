@@ -0,0 +1,251 @@
+/**
+ *  Copyright 2013 by Benjamin J. Land (a.k.a. BenLand100)
+ *
+ *  This file is part of L, a virtual machine for a lisp-like language.
+ *
+ *  L is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  L is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with L. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "optimize.h"
+#include "primitives.h"
+#include "resolve.h"
+#include "parser.h"
+
+static bool optimize_init_flag = false;
+static T_SYMBOL sym_rest;
+static T_SYMBOL sym_optional;
+
+//primitives without side effects that optimize may run on constants
+static const NATIVE_FUNC pure_prims[] = {
+    (NATIVE_FUNC)l_add, (NATIVE_FUNC)l_sub, (NATIVE_FUNC)l_mul, (NATIVE_FUNC)l_div,
+    (NATIVE_FUNC)l_lt, (NATIVE_FUNC)l_gt, (NATIVE_FUNC)l_eq, (NATIVE_FUNC)l_le, (NATIVE_FUNC)l_ge,
+    (NATIVE_FUNC)l_add2, (NATIVE_FUNC)l_sub2, (NATIVE_FUNC)l_mul2, (NATIVE_FUNC)l_div2,
+    (NATIVE_FUNC)l_lt2, (NATIVE_FUNC)l_gt2, (NATIVE_FUNC)l_eq2, (NATIVE_FUNC)l_le2, (NATIVE_FUNC)l_ge2
+};
+
+#define FOLD_MAX_ARGS   16
+
+static bool isPrim(VALUE *val, T_TYPE spec) {
+    return val && typeOf(val) == ID_PRIMFUNC && ((PRIMFUNC*)val)->spec == spec;
+}
+
+static bool isQuote(VALUE *val) {
+    return val && typeOf(val) == ID_NODE && isPrim(((NODE*)val)->data,SPEC_QUOTE);
+}
+
+static bool isLambda(VALUE *val) {
+    return val && typeOf(val) == ID_NODE && isPrim(((NODE*)val)->data,SPEC_LAMBDA)
+        && ((NODE*)val)->addr && typeOf(((NODE*)val)->addr) == ID_NODE;
+}
+
+//a LAMBDA whose body is already expanded
+static bool isExpanded(VALUE *val) {
+    return isLambda(val) && !(((NODE*)((NODE*)val)->addr)->flags & FLAG_LAZY);
+}
+
+static bool isNumber(VALUE *val) {
+    return val && (typeOf(val) == ID_INTEGER || typeOf(val) == ID_REAL);
+}
+
+//forms that evaluate to themselves or to a quoted datum
+static bool isConstant(VALUE *val) {
+    if (!val || isIMMEDIATE(val)) return true;
+    switch (val->type) {
+        case ID_INTEGER:
+        case ID_REAL:
+        case ID_STRING:
+            return true;
+        case ID_NODE:
+            return isQuote(val);
+    }
+    return false;
+}
+
+//value of a constant form for COND: only NIL and 'NIL are false
+static bool constantTrue(VALUE *val) {
+    if (!val) return false;
+    if (isQuote(val)) {
+        NODE *quoted = (NODE*)((NODE*)val)->addr;
+        return quoted && typeOf(quoted) == ID_NODE && quoted->data;
+    }
+    return true;
+}
+
+//forms that can be dropped when their value is unused; not symbols, since
+//reading an unbound one is an error
+static bool isPure(VALUE *val) {
+    return isConstant(val) || isLambda(val) || typeOf(val) == ID_PRIMFUNC;
+}
+
+static int list_count(VALUE *list) {
+    int len = 0;
+    for (; list && typeOf(list) == ID_NODE; list = ((NODE*)list)->addr) len++;
+    return list ? -1 : len;
+}
+
+static void optimize_list(VALUE *list) {
+    for (; list && typeOf(list) == ID_NODE && !isCONST(list); list = ((NODE*)list)->addr) {
+        ((NODE*)list)->data = optimize(((NODE*)list)->data);
+    }
+}
+
+static VALUE* quoteForm(VALUE *val) {
+    return (VALUE*)newNODE(newPRIMFUNC(SPEC_QUOTE,ABI_LIST,(NATIVE_FUNC)l_quote),newNODE(val,NIL));
+}
+
+//replaces form with a reference to one of its parts
+static VALUE* replaceWith(VALUE *form, VALUE *part) {
+    incRef(part);
+    decRef(form);
+    return part;
+}
+
+//runs a pure primitive now if every argument is a number
+static VALUE* optimize_fold(NODE *form) {
+    PRIMFUNC *prim = (PRIMFUNC*)form->data;
+    if (prim->abi != ABI_ARGV) return (VALUE*)form;
+    bool pure = false;
+    for (size_t i = 0; i < sizeof(pure_prims)/sizeof(NATIVE_FUNC); i++) {
+        if (prim->native == pure_prims[i]) pure = true;
+    }
+    if (!pure) return (VALUE*)form;
+    VALUE *argv[FOLD_MAX_ARGS];
+    int argc = 0;
+    for (VALUE *arg = form->addr; arg; arg = ((NODE*)arg)->addr) {
+        if (typeOf(arg) != ID_NODE || argc == FOLD_MAX_ARGS || !isNumber(((NODE*)arg)->data)) return (VALUE*)form;
+        argv[argc++] = ((NODE*)arg)->data;
+    }
+    if (!argc) return (VALUE*)form; //leave the arity error to runtime
+    if (prim->native == (NATIVE_FUNC)l_div || prim->native == (NATIVE_FUNC)l_div2) {
+        for (int i = 1; i < argc; i++) {
+            if (asNUMBER(argv[i]) == 0) return (VALUE*)form;
+        }
+    }
+    VALUE *res = call_prim(prim,argc,argv,NIL);
+    debugVal(res,"folded: ");
+    decRef(form);
+    if (res && typeOf(res) == ID_SYMBOL) return quoteForm(res); //T
+    return res;
+}
+
+static VALUE* optimize_cond(NODE *form) {
+    for (VALUE *clause = form->addr; clause; clause = ((NODE*)clause)->addr) {
+        if (typeOf(clause) != ID_NODE || list_count(((NODE*)clause)->data) != 2) return (VALUE*)form; //malformed, fails at runtime
+    }
+    for (VALUE *clause = form->addr; clause; clause = ((NODE*)clause)->addr) {
+        NODE *test = (NODE*)((NODE*)clause)->data;
+        test->data = optimize(test->data);
+        ((NODE*)test->addr)->data = optimize(((NODE*)test->addr)->data);
+    }
+    for (NODE *clause = (NODE*)form->addr, *last = NIL; clause; ) {
+        NODE *test = (NODE*)clause->data;
+        if (!isConstant(test->data)) {
+            clause = (NODE*)(last = clause)->addr;
+            continue;
+        }
+        if (constantTrue(test->data)) {
+            if (!last) return replaceWith((VALUE*)form,((NODE*)test->addr)->data);
+            decRef(clause->addr); //later clauses are unreachable
+            clause->addr = NIL;
+            break;
+        }
+        NODE *next = (NODE*)clause->addr;
+        clause->addr = NIL;
+        decRef(clause);
+        if (last) last->addr = (VALUE*)next; else form->addr = (VALUE*)next;
+        clause = next;
+    }
+    if (!form->addr) {
+        decRef(form);
+        return NIL;
+    }
+    return (VALUE*)form;
+}
+
+static VALUE* optimize_prog(NODE *form) {
+    optimize_list(form->addr);
+    for (NODE *sub = (NODE*)form->addr, *last = NIL; sub && typeOf(sub) == ID_NODE; ) {
+        if (sub->addr && !isCONST(sub) && isPure(sub->data)) {
+            NODE *next = (NODE*)sub->addr;
+            sub->addr = NIL;
+            decRef(sub);
+            if (last) last->addr = (VALUE*)next; else form->addr = (VALUE*)next;
+            sub = next;
+        } else {
+            sub = (NODE*)(last = sub)->addr;
+        }
+    }
+    return (VALUE*)form;
+}
+
+//((LAMBDA () body)) and ((LAMBDA (x) x) arg)
+static VALUE* optimize_apply(NODE *form) {
+    NODE *lambda = (NODE*)((NODE*)form->data)->addr;
+    VALUE *vars = lambda_written(lambda->data), *body = lambda->addr;
+    if (!vars && !form->addr && !resolve_binds(body)) {
+        if (!body || typeOf(body) != ID_NODE) return replaceWith((VALUE*)form,NIL);
+        if (!((NODE*)body)->addr) return replaceWith((VALUE*)form,((NODE*)body)->data);
+        incRef(body);
+        decRef(form);
+        return (VALUE*)newNODE(newPRIMFUNC(SPEC_MACRO,ABI_LIST,(NATIVE_FUNC)l_prog),body);
+    }
+    if (list_count(vars) == 1 && list_count(body) == 1 && list_count(form->addr) == 1) {
+        VALUE *var = ((NODE*)vars)->data, *ret = ((NODE*)body)->data;
+        if (!var || typeOf(var) != ID_SYMBOL || !ret || typeOf(ret) != ID_SYMBOL) return (VALUE*)form;
+        T_SYMBOL sym = ((SYMBOL*)var)->sym;
+        if (sym == sym_rest || sym == sym_optional || sym != ((SYMBOL*)ret)->sym) return (VALUE*)form;
+        return replaceWith((VALUE*)form,((NODE*)form->addr)->data);
+    }
+    return (VALUE*)form;
+}
+
+//consumes form and returns its optimized replacement
+VALUE* optimize(VALUE *form) {
+    if (!optimize_init_flag) {
+        optimize_init_flag = true;
+        sym_rest = intern("&REST");
+        sym_optional = intern("&OPTIONAL");
+    }
+    if (!form || typeOf(form) != ID_NODE || isCONST(form) || ((NODE*)form)->datatype != DATA_NODE) return form;
+    NODE *node = (NODE*)form;
+    VALUE *head = node->data;
+    if (head && typeOf(head) == ID_PRIMFUNC) {
+        PRIMFUNC *prim = (PRIMFUNC*)head;
+        switch (prim->spec) {
+            case SPEC_QUOTE:
+            case SPEC_MACRODEF:
+                return form;
+            case SPEC_LAMBDA:
+                if (isExpanded(form)) optimize_list(((NODE*)node->addr)->addr);
+                return form;
+            case SPEC_MACRO:
+                if (prim->native == (NATIVE_FUNC)l_cond) return optimize_cond(node);
+                if (prim->native == (NATIVE_FUNC)l_prog) return optimize_prog(node);
+                optimize_list(node->addr);
+                return form;
+            case SPEC_FUNC:
+                optimize_list(node->addr);
+                return optimize_fold(node);
+        }
+        return form;
+    }
+    if (isExpanded(head)) {
+        node->data = optimize(head);
+        NODE *vars = (NODE*)lambda_written(((NODE*)((NODE*)head)->addr)->data);
+        if (vars && typeOf(vars) == ID_NODE && !vars->addr && vars->data && typeOf(vars->data) == ID_NODE) return form; //((a b)): arguments unevaluated
+        optimize_list(node->addr);
+        return optimize_apply(node);
+    }
+    return form;
+}
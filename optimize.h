@@ -0,0 +1,36 @@
+/**
+ *  Copyright 2013 by Benjamin J. Land (a.k.a. BenLand100)
+ *
+ *  This file is part of L, a virtual machine for a lisp-like language.
+ *
+ *  L is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  L is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with L. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _OPTIMIZE
+#define _OPTIMIZE
+
+#include "lisp.h"
+
+//rewriting pass over macroexpanded code, run before resolve:
+// - calls of arithmetic and comparison primitives on numeric constants are folded
+// - COND clauses with a constant test are dropped or taken statically
+// - PROG subforms whose value is unused and that cannot have effects are dropped
+// - ((LAMBDA () body)) becomes (PROG body) if body does not BIND, and
+//   ((LAMBDA (x) x) arg) becomes arg
+//arguments of calls through symbols are left as written, since the callee may
+//take them unevaluated.
+
+VALUE* optimize(VALUE *form);
+
+#endif
@@ -21,46 +21,168 @@
 #include "listops.h"
 #include "primitives.h"
 #include "binmap.h"
+#include "gc.h"
 #include <ctype.h>
 
-T_SYMBOL hash(char *sym) {
-    T_SYMBOL hval = 0xAAAAAAAA;
-    for (int i = 0; sym[i]; i++) hval ^= ((T_SYMBOL)sym[i]) << ((4*i)%24);
+//symbols are dense ids (NIL is 0) into sym_names; interning goes through an
+//open-addressing table of ids keyed by a FNV-1a/murmur-finalized hash of the
+//upper-cased name, and names live in a chunked arena that never moves
+
+#define SYM_ARENA   4096
+
+static bool parser_ready = false;
+static const char **sym_names = NIL;
+static unsigned int *sym_hashes = NIL;
+static T_SYMBOL sym_len = 0, sym_cap = 0;
+static T_SYMBOL *sym_table = NIL; //id+1 per slot, 0 is empty
+static T_SYMBOL sym_table_cap = 0;
+static char *arena = NIL;
+static size_t arena_left = 0;
+
+static unsigned int hash(const char *sym) {
+    unsigned int hval = 2166136261u;
+    for (int i = 0; sym[i]; i++) {
+        hval ^= (unsigned char)toupper(sym[i]);
+        hval *= 16777619u;
+    }
+    hval ^= hval >> 16;
+    hval *= 0x85ebca6bu;
+    hval ^= hval >> 13;
+    hval *= 0xc2b2ae35u;
+    hval ^= hval >> 16;
     return hval;
 }
 
-static NODE *sym_map = NIL;
+static bool sym_equal(const char *name, const char *sym) {
+    while (*name && *name == toupper(*sym)) {
+        name++;
+        sym++;
+    }
+    return *name == toupper(*sym);
+}
+
+static const char* arena_store(const char *sym, size_t len) {
+    if (len + 1 > arena_left) {
+        arena_left = len + 1 > SYM_ARENA ? len + 1 : SYM_ARENA;
+        arena = (char*)malloc(arena_left);
+        failNIL(arena,"Out of memory");
+    }
+    char *name = arena;
+    for (size_t i = 0; i < len; i++) name[i] = toupper(sym[i]);
+    name[len] = '\0';
+    arena += len + 1;
+    arena_left -= len + 1;
+    return name;
+}
+
+static void sym_grow() {
+    T_SYMBOL cap = sym_table_cap ? sym_table_cap*2 : 1024;
+    T_SYMBOL *table = (T_SYMBOL*)calloc(cap,sizeof(T_SYMBOL));
+    failNIL(table,"Out of memory");
+    for (T_SYMBOL id = 0; id < sym_len; id++) {
+        T_SYMBOL i = sym_hashes[id] & (cap-1);
+        while (table[i]) i = (i+1) & (cap-1);
+        table[i] = id+1;
+    }
+    free(sym_table);
+    sym_table = table;
+    sym_table_cap = cap;
+}
+
 static NODE *literal_map = NIL;
 static NODE *literal_name_map = NIL;
 
-#define addPrimFunc(sym,spec,func) { \
-    binmap_put(newSYMBOL(intern(#sym)),newPRIMFUNC(spec,(NATIVE_FUNC)func),literal_map); \
-    binmap_put(newPRIMFUNC(spec,(NATIVE_FUNC)func),newSTRING(#sym),literal_name_map); \
+#define addPrimFunc(sym,spec,abi,func) { \
+    binmap_put(newSYMBOL(intern(#sym)),newPRIMFUNC(spec,abi,(NATIVE_FUNC)func),literal_map); \
+    binmap_put(newPRIMFUNC(spec,abi,(NATIVE_FUNC)func),newSTRING(#sym),literal_name_map); \
 }
+//names a primitive that has no symbol of its own, such as a two-operand kernel
+#define addPrimName(sym,func) \
+    binmap_put(newPRIMFUNC(SPEC_FUNC,ABI_ARGV,(NATIVE_FUNC)func),newSTRING(#sym),literal_name_map);
+
 void parser_init() {
     debug("Defining built-in symbols\n");
-    sym_map = binmap(newSYMBOL(hash("NIL")),newSTRING("NIL"));
+    parser_ready = true;
     literal_map = binmap(newSYMBOL(intern("NIL")),NIL);
-    literal_name_map = binmap(newPRIMFUNC(SPEC_LAMBDA,l_lambda),newSTRING(strdup("LAMBDA")));
-    addPrimFunc(LAMBDA,SPEC_LAMBDA,l_lambda);
-    addPrimFunc(PROG,SPEC_MACRO,l_prog);
-    addPrimFunc(COND,SPEC_MACRO,l_cond);
-    addPrimFunc(MACRO,SPEC_MACRODEF,l_macro);
-    addPrimFunc(QUOTE,SPEC_QUOTE,l_quote);
-    addPrimFunc(NODE,SPEC_FUNC,l_node);
-    addPrimFunc(LIST,SPEC_MACRO,l_list);
-    addPrimFunc(ADDR,SPEC_FUNC,l_addr);
-    addPrimFunc(DATA,SPEC_FUNC,l_data);
-    addPrimFunc(SETA,SPEC_FUNC,l_seta);
-    addPrimFunc(SETD,SPEC_FUNC,l_setd);
-    addPrimFunc(REF,SPEC_FUNC,l_ref);
-    addPrimFunc(BIND,SPEC_FUNC,l_bind);
-    addPrimFunc(+,SPEC_FUNC,l_add);
-    addPrimFunc(-,SPEC_FUNC,l_sub);
-    addPrimFunc(*,SPEC_FUNC,l_mul);
-    addPrimFunc(/,SPEC_FUNC,l_div);
-    addPrimFunc(PRINT,SPEC_FUNC,l_print);
-    addPrimFunc(ISNODE,SPEC_FUNC,l_isnode);
+    literal_name_map = binmap(newPRIMFUNC(SPEC_LAMBDA,ABI_LIST,l_lambda),newSTRING(strdup("LAMBDA")));
+    gc_root((VALUE**)&literal_map);
+    gc_root((VALUE**)&literal_name_map);
+    addPrimFunc(LAMBDA,SPEC_LAMBDA,ABI_LIST,l_lambda);
+    addPrimFunc(PROG,SPEC_MACRO,ABI_LIST,l_prog);
+    addPrimFunc(COND,SPEC_MACRO,ABI_LIST,l_cond);
+    addPrimFunc(WHILE,SPEC_MACRO,ABI_LIST,l_while);
+    addPrimFunc(DOTIMES,SPEC_MACRO,ABI_LIST,l_dotimes);
+    addPrimFunc(DOLIST,SPEC_MACRO,ABI_LIST,l_dolist);
+    addPrimFunc(MACRO,SPEC_MACRODEF,ABI_LIST,l_macro);
+    addPrimFunc(QUOTE,SPEC_QUOTE,ABI_LIST,l_quote);
+    addPrimFunc(NODE,SPEC_FUNC,ABI_ARGV,l_node);
+    addPrimFunc(LIST,SPEC_MACRO,ABI_LIST,l_list);
+    addPrimFunc(ADDR,SPEC_FUNC,ABI_ARGV,l_addr);
+    addPrimFunc(DATA,SPEC_FUNC,ABI_ARGV,l_data);
+    addPrimFunc(SETA,SPEC_FUNC,ABI_ARGV,l_seta);
+    addPrimFunc(SETD,SPEC_FUNC,ABI_ARGV,l_setd);
+    addPrimFunc(REF,SPEC_FUNC,ABI_ARGV,l_ref);
+    addPrimFunc(BIND,SPEC_FUNC,ABI_ARGV,l_bind);
+    addPrimFunc(+,SPEC_FUNC,ABI_ARGV,l_add);
+    addPrimFunc(-,SPEC_FUNC,ABI_ARGV,l_sub);
+    addPrimFunc(*,SPEC_FUNC,ABI_ARGV,l_mul);
+    addPrimFunc(/,SPEC_FUNC,ABI_ARGV,l_div);
+    addPrimFunc(<,SPEC_FUNC,ABI_ARGV,l_lt);
+    addPrimFunc(>,SPEC_FUNC,ABI_ARGV,l_gt);
+    addPrimFunc(=,SPEC_FUNC,ABI_ARGV,l_eq);
+    addPrimFunc(<=,SPEC_FUNC,ABI_ARGV,l_le);
+    addPrimFunc(>=,SPEC_FUNC,ABI_ARGV,l_ge);
+    addPrimName(+,l_add2);
+    addPrimName(-,l_sub2);
+    addPrimName(*,l_mul2);
+    addPrimName(/,l_div2);
+    addPrimName(<,l_lt2);
+    addPrimName(>,l_gt2);
+    addPrimName(=,l_eq2);
+    addPrimName(<=,l_le2);
+    addPrimName(>=,l_ge2);
+    addPrimFunc(VECTOR,SPEC_FUNC,ABI_ARGV,l_vector);
+    addPrimFunc(MAKE-VECTOR,SPEC_FUNC,ABI_ARGV,l_makevector);
+    addPrimFunc(LIST-VECTOR,SPEC_FUNC,ABI_ARGV,l_listvector);
+    addPrimFunc(VECTOR-LIST,SPEC_FUNC,ABI_ARGV,l_vectorlist);
+    addPrimFunc(VLEN,SPEC_FUNC,ABI_ARGV,l_vlen);
+    addPrimFunc(VREF,SPEC_FUNC,ABI_ARGV,l_vref);
+    addPrimFunc(VSET,SPEC_FUNC,ABI_ARGV,l_vset);
+    addPrimFunc(V+,SPEC_FUNC,ABI_ARGV,l_vadd);
+    addPrimFunc(V-,SPEC_FUNC,ABI_ARGV,l_vsub);
+    addPrimFunc(V*,SPEC_FUNC,ABI_ARGV,l_vmul);
+    addPrimFunc(V/,SPEC_FUNC,ABI_ARGV,l_vdiv);
+    addPrimFunc(VDOT,SPEC_FUNC,ABI_ARGV,l_vdot);
+    addPrimFunc(VSUM,SPEC_FUNC,ABI_ARGV,l_vsum);
+    addPrimFunc(VMIN,SPEC_FUNC,ABI_ARGV,l_vmin);
+    addPrimFunc(VMAX,SPEC_FUNC,ABI_ARGV,l_vmax);
+    addPrimFunc(MAKE-ARRAY,SPEC_FUNC,ABI_ARGV,l_makearray);
+    addPrimFunc(AREF,SPEC_FUNC,ABI_ARGV,l_aref);
+    addPrimFunc(ASET,SPEC_FUNC,ABI_ARGV,l_aset);
+    addPrimFunc(PUSH,SPEC_FUNC,ABI_ARGV,l_push);
+    addPrimFunc(LENGTH,SPEC_FUNC,ABI_ARGV,l_length);
+    addPrimFunc(MAKE-HASH,SPEC_FUNC,ABI_ARGV,l_makehash);
+    addPrimFunc(GETHASH,SPEC_FUNC,ABI_ARGV,l_gethash);
+    addPrimFunc(PUTHASH,SPEC_FUNC,ABI_ARGV,l_puthash);
+    addPrimFunc(REMHASH,SPEC_FUNC,ABI_ARGV,l_remhash);
+    addPrimFunc(HASH-COUNT,SPEC_FUNC,ABI_ARGV,l_hashcount);
+    addPrimFunc(HASH-PAIRS,SPEC_FUNC,ABI_ARGV,l_hashpairs);
+    addPrimFunc(HCONS,SPEC_FUNC,ABI_ARGV,l_hcons);
+    addPrimFunc(SHARE,SPEC_FUNC,ABI_ARGV,l_share);
+    addPrimFunc(HASH,SPEC_FUNC,ABI_ARGV,l_hash);
+    addPrimFunc(EQUAL,SPEC_FUNC,ABI_ARGV,l_equal);
+    addPrimFunc(MEMOIZE,SPEC_FUNC,ABI_ARGV,l_memoize);
+    addPrimFunc(MEMO-STATS,SPEC_FUNC,ABI_ARGV,l_memostats);
+    addPrimFunc(MEMO-FORGET,SPEC_FUNC,ABI_ARGV,l_memoforget);
+    addPrimFunc(MEMO-CLEAR,SPEC_FUNC,ABI_ARGV,l_memoclear);
+    addPrimFunc(MEMO-LIMIT,SPEC_FUNC,ABI_ARGV,l_memolimit);
+    addPrimFunc(PRINT,SPEC_FUNC,ABI_ARGV,l_print);
+    addPrimFunc(ISNODE,SPEC_FUNC,ABI_ARGV,l_isnode);
+    addPrimFunc(MEMSTATS,SPEC_FUNC,ABI_LIST,l_memstats);
+#ifdef TRACING_GC
+    addPrimFunc(GC,SPEC_FUNC,ABI_LIST,l_gc);
+    addPrimFunc(GCSTATS,SPEC_FUNC,ABI_LIST,l_gcstats);
+#endif
 }
 
 
@@ -75,48 +197,43 @@ const char* prim_str(PRIMFUNC *prim) {
     }
 }
 
+const char* sym_name(T_SYMBOL sym) {
+    return sym < sym_len ? sym_names[sym] : NIL;
+}
+
 const char* sym_str(SYMBOL *sym) {
-    NODE *entry = binmap_find(sym,sym_map);
-    if (entry) {
-        const char* str = ((STRING*)entry->addr)->str;
-        decRef(entry);
-        return str;
-    } else {
-        return NIL;
-    }
+    return sym_name(sym->sym);
+}
+
+T_SYMBOL sym_count() {
+    return sym_len;
 }
 
 T_SYMBOL intern(char *c_str) {
-    if (!sym_map) parser_init();
-    c_str = strdup(c_str);
-    for (int i = 0; c_str[i]; i++) c_str[i] = toupper(c_str[i]);
-    debug("intern: %s %u\n",c_str,hash(c_str));
-    SYMBOL *sym = newSYMBOL(hash(c_str));
-    STRING *str = newSTRING(c_str);
-    NODE *entry;
-    while ((entry = binmap_find(sym,sym_map))) {
-        debugVal(entry,"matching: ");
-        if (cmpSTRING((STRING*)entry->addr,str)) {
-            decRef(entry);
-            sym->sym++;
-        } else {
-            break;
-        }
+    if (!parser_ready) parser_init();
+    unsigned int hval = hash(c_str);
+    debug("intern: %s %u\n",c_str,hval);
+    if (2*(sym_len+1) > sym_table_cap) sym_grow();
+    T_SYMBOL i = hval & (sym_table_cap-1);
+    for (; sym_table[i]; i = (i+1) & (sym_table_cap-1)) {
+        T_SYMBOL id = sym_table[i]-1;
+        if (sym_hashes[id] == hval && sym_equal(sym_names[id],c_str)) return id;
     }
-    if (!entry) {
-        debug("adding symbol: %s\n",c_str);
-        binmap_put(sym,str,sym_map);
-        return sym->sym;
-    } else {
-        decRef(sym);
-        decRef(str);
-        decRef(entry);
-        return ((SYMBOL*)entry->data)->sym;
+    debug("adding symbol: %s\n",c_str);
+    if (sym_len == sym_cap) {
+        sym_cap = sym_cap ? sym_cap*2 : 512;
+        sym_names = (const char**)realloc(sym_names,sym_cap*sizeof(const char*));
+        sym_hashes = (unsigned int*)realloc(sym_hashes,sym_cap*sizeof(unsigned int));
+        failNIL(sym_names && sym_hashes,"Out of memory");
     }
+    sym_names[sym_len] = arena_store(c_str,strlen(c_str));
+    sym_hashes[sym_len] = hval;
+    sym_table[i] = sym_len+1;
+    return sym_len++;
 }
 
 NODE* parse(char **exp) {
-    if (!sym_map) parser_init();
+    if (!parser_ready) parser_init();
     debug("Parse List: %s\n",*exp);
     NODE *head = NIL;
     while (**exp) {
@@ -125,8 +242,10 @@ NODE* parse(char **exp) {
                 debug("to quote: %s\n",*exp);
                 NODE *quoted = parse(exp);
                 debugVal(quoted->data,"quoted: ");
-                list_push(newNODE(newPRIMFUNC(SPEC_QUOTE,l_quote),newNODE(quoted->data,NIL)),&head);
+                list_push(newNODE(newPRIMFUNC(SPEC_QUOTE,ABI_LIST,l_quote),newNODE(quoted->data,NIL)),&head);
                 if (quoted->addr) head = list_join(list_reverse((NODE*)quoted->addr),head);
+                quoted->data = quoted->addr = NIL; //both moved into head
+                decRef(quoted);
                 head = list_reverse(head);
                 debugVal(head,"expression: ");
                 return head;
@@ -193,7 +312,7 @@ NODE* parse(char **exp) {
                         break;
                  }
                  **exp = old;
-                 if (head->data->type == ID_SYMBOL) {
+                 if (typeOf(head->data) == ID_SYMBOL) {
                     NODE *literal;
                     if ((literal = binmap_find(head->data,literal_map))) {
                         NODE *last = (NODE*)head->addr;
@@ -219,5 +338,5 @@ NODE* parseForms(char *exp) {
     char *org = dup;
     NODE *forms = parse(&dup);
     free(org);
-    return newNODE(newPRIMFUNC(SPEC_MACRO,l_prog),forms);
+    return newNODE(newPRIMFUNC(SPEC_MACRO,ABI_LIST,l_prog),forms);
 }
@@ -24,7 +24,9 @@
 
 T_SYMBOL intern(char *sym);
 const char* prim_str(PRIMFUNC *prim);
+const char* sym_name(T_SYMBOL sym);
 const char* sym_str(SYMBOL *sym);
+T_SYMBOL sym_count();
 NODE* parseForms(char *exp);
 
 #endif
@@ -21,9 +21,19 @@
 #include "listops.h"
 #include "scope.h"
 #include "parser.h"
+#include "gc.h"
+#include "vector.h"
+#include "hash.h"
+#include "memo.h"
 
+//evaluates the arguments left to right
 NODE* l_list(NODE *args, NODE *scope) {
-    return args ? newNODE(evaluate(args->data,scope),l_list(asNODE(args->addr),scope)) : NIL;
+    NODE *head = NIL, **tail = &head;
+    for (; args; args = asNODE(args->addr)) {
+        *tail = newNODE(evaluate(args->data,scope),NIL);
+        tail = (NODE**)&(*tail)->addr;
+    }
+    return head;
 }
 
 VALUE* l_prog(NODE *args, NODE *scope) {
@@ -50,13 +60,96 @@ VALUE* l_cond(NODE *args, NODE *scope) {
     return NIL;
 }
 
+static void loop_body(NODE *body, NODE *scope, EVAL_FUNC eval) {
+    for (; body; body = asNODE(body->addr)) decRef(eval(body->data,scope));
+}
+
+//(while test body...) runs body until test is NIL
+static VALUE* loop_while(NODE *args, NODE *scope, EVAL_FUNC eval) {
+    if (!args) error("WHILE takes at least 1 argument");
+    for (;;) {
+        VALUE *test = eval(args->data,scope);
+        if (!test) return NIL;
+        decRef(test);
+        loop_body(asNODE(args->addr),scope,eval);
+    }
+}
+
+//evaluates the value of a (var value) header in scope and pushes the loop's
+//frame, which holds var for every iteration
+static NODE* loop_enter(NODE *args, NODE *scope, EVAL_FUNC eval, VALUE **value) {
+    NODE *header = asNODE(args ? args->data : NIL);
+    if (list_length(header) != 2) error("Malformed loop header");
+    *value = eval(asNODE(header->addr)->data,scope);
+    return scope_pushFrame(scope,scope_loopArgs(header));
+}
+
+//(dotimes (var count) body...) runs body with var from 0 below count
+static VALUE* loop_dotimes(NODE *args, NODE *scope, EVAL_FUNC eval) {
+    VALUE *count;
+    NODE *loop_scope = loop_enter(args,scope,eval,&count);
+    T_INTEGER n = asINTEGER(count);
+    decRef(count);
+    for (T_INTEGER i = 0; i < n; i++) {
+        scope_setSlot(0,newINTEGER(i),loop_scope);
+        loop_body(asNODE(args->addr),loop_scope,eval);
+    }
+    scope_pop(loop_scope);
+    return NIL;
+}
+
+//(dolist (var list) body...) runs body with var on each element of list
+static VALUE* loop_dolist(NODE *args, NODE *scope, EVAL_FUNC eval) {
+    VALUE *list;
+    NODE *loop_scope = loop_enter(args,scope,eval,&list);
+    for (NODE *rest = asNODE(list); rest; rest = asNODE(rest->addr)) {
+        incRef(rest->data);
+        scope_setSlot(0,rest->data,loop_scope);
+        loop_body(asNODE(args->addr),loop_scope,eval);
+    }
+    decRef(list);
+    scope_pop(loop_scope);
+    return NIL;
+}
+
+VALUE* l_while(NODE *args, NODE *scope) {
+    return loop_while(args,scope,evaluate);
+}
+
+VALUE* l_dotimes(NODE *args, NODE *scope) {
+    return loop_dotimes(args,scope,evaluate);
+}
+
+VALUE* l_dolist(NODE *args, NODE *scope) {
+    return loop_dolist(args,scope,evaluate);
+}
+
+//runs prim with eval if it is one of the loops
+bool loop_run(PRIMFUNC *prim, NODE *args, NODE *scope, EVAL_FUNC eval, VALUE **res) {
+    if (prim->native == (NATIVE_FUNC)l_while) {
+        *res = loop_while(args,scope,eval);
+    } else if (prim->native == (NATIVE_FUNC)l_dotimes) {
+        *res = loop_dotimes(args,scope,eval);
+    } else if (prim->native == (NATIVE_FUNC)l_dolist) {
+        *res = loop_dolist(args,scope,eval);
+    } else {
+        return false;
+    }
+    return true;
+}
+
 VALUE* l_macro(NODE *args, NODE *scope) {
     error("MACRO called as a function.");
 }
 
 VALUE* l_lambda(NODE *args, NODE *scope) {
+    ARGSPEC *spec = args ? scope_argspec(args) : NIL;
+    if (spec && spec->closed) {
+        scope = scope_capture(spec,scope);
+    } else {
+        incRef(scope);
+    }
     incRef(args); 
-    incRef(scope); 
     NODE *f = newNODE(scope,args); 
     f->datatype = DATA_FUNCTION; 
     return (VALUE*)f;
@@ -64,35 +157,38 @@ VALUE* l_lambda(NODE *args, NODE *scope) {
 
 VALUE* l_quote(NODE *args, NODE *scope) {
     if (args->addr) error("QUOTE takes exactly 1 argument");
-    return deep_copy(args->data);
+    constify(args->data);
+    incRef(args->data);
+    return args->data;
 }
 
-VALUE* l_node(NODE *args, NODE *scope) {
-    if (list_length(args) != 2) error("SETD takes exactly 2 arguments");
-    incRef(args->data);
-    incRef(((NODE*)args->addr)->data);
-    return (VALUE*)newNODE(args->data,((NODE*)args->addr)->data);
+VALUE* l_node(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 2) error("NODE takes exactly 2 arguments");
+    incRef(argv[0]);
+    incRef(argv[1]);
+    return (VALUE*)newNODE(argv[0],argv[1]);
 }
 
-VALUE* l_data(NODE *args, NODE *scope) {
-    if (args->addr) error("DATA takes exactly 1 argument");
-    VALUE *res = asNODE(args->data)->data;
+VALUE* l_data(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 1) error("DATA takes exactly 1 argument");
+    VALUE *res = asNODE(argv[0])->data;
     incRef(res);
     return res;
 }
 
-VALUE* l_addr(NODE *args, NODE *scope) {
-    if (args->addr) error("ADDR takes exactly 1 argument");
-    VALUE *res = asNODE(args->data)->addr;
+VALUE* l_addr(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 1) error("ADDR takes exactly 1 argument");
+    VALUE *res = asNODE(argv[0])->addr;
     incRef(res);
     return res;
 }
 
-VALUE* l_setd(NODE *args, NODE *scope) {
-    if (list_length(args) != 2) error("SETD takes exactly 2 arguments");
-    NODE *n = asNODE(args->data);
-    VALUE *v = asNODE(args->addr)->data;
+VALUE* l_setd(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 2) error("SETD takes exactly 2 arguments");
+    NODE *n = asNODE(argv[0]);
+    VALUE *v = argv[1];
     failNIL(n,"NIL is not a NODE");
+    if (isCONST(n)) error("SETD cannot modify a quoted constant");
     decRef(n->data);
     incRef(v);
     incRef(v);
@@ -100,11 +196,12 @@ VALUE* l_setd(NODE *args, NODE *scope) {
     return v;
 }
 
-VALUE* l_seta(NODE *args, NODE *scope) {
-    if (list_length(args) != 2) error("SETA takes exactly 2 arguments");
-    NODE *n = asNODE(args->data);
-    VALUE *v = asNODE(args->addr)->data;
+VALUE* l_seta(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 2) error("SETA takes exactly 2 arguments");
+    NODE *n = asNODE(argv[0]);
+    VALUE *v = argv[1];
     failNIL(n,"NIL is not a NODE");
+    if (isCONST(n)) error("SETA cannot modify a quoted constant");
     decRef(n->addr);
     incRef(v);
     incRef(v);
@@ -112,158 +209,474 @@ VALUE* l_seta(NODE *args, NODE *scope) {
     return v;
 }
 
-VALUE* l_ref(NODE *args, NODE *scope) {
-    if (args->addr) error("REF takes exactly 1 argument");
-    NODE *ref = scope_ref(asSYMBOL(args->data),scope);
+VALUE* l_ref(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 1) error("REF takes exactly 1 argument");
+    NODE *ref = scope_ref(asSYMBOL(argv[0]),scope);
     failNIL(ref,"Cannot reference unbound symbol");
     return (VALUE*)ref;
 }
 
-VALUE* l_bind(NODE *args, NODE *scope) {
-    if (list_length(args) != 2) error("BIND takes exactly 2 arguments");
-    scope_bind(asSYMBOL(args->data),asNODE(args->addr)->data,scope);
-    incRef(asNODE(args->addr)->data);
-    return asNODE(args->addr)->data;
+VALUE* l_bind(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 2) error("BIND takes exactly 2 arguments");
+    scope_bind(asSYMBOL(argv[0]),argv[1],scope);
+    incRef(argv[1]);
+    return argv[1];
 }
 
-
-VALUE* l_add(NODE *args, NODE *scope) {
-    debugVal(args,"add: ");
-    bool real = false;
-    T_REAL accum_r = 0;
-    T_INTEGER accum_i = 0;
-    while (args) {
-        failNIL(args->data,"NIL is not a number");
-        if (real) {
-            if (args->data->type == ID_REAL) {
-                accum_r += ((REAL*)args->data)->val;
-            } else {
-                accum_r += asINTEGER(args->data)->val;
-            }
-        } else {
-            if (args->data->type == ID_REAL) {
-                real = true;
-                accum_r = accum_i + ((REAL*)args->data)->val;
-            } else {
-                accum_i += asINTEGER(args->data)->val;
-            }
-        }
-        args = asNODE(args->addr);
-    }    
+//folds op over the arguments, starting from the first one or from identity,
+//and switching to reals at the first REAL
+#define arith_fold(name,op,first,identity) \
+    bool real = false; \
+    T_REAL accum_r = 0; \
+    T_INTEGER accum_i = 0; \
+    int i = 0; \
+    if (first) { \
+        if (!argc) error(name" takes at least 1 argument"); \
+        failNIL(argv[0],"NIL is not a number"); \
+        if (typeOf(argv[0]) == ID_REAL) { \
+            accum_r = asREAL(argv[0]); \
+            real = true; \
+        } else { \
+            accum_i = asINTEGER(argv[0]); \
+        } \
+        i = 1; \
+    } else { \
+        accum_r = accum_i = identity; \
+    } \
+    for (; i < argc; i++) { \
+        failNIL(argv[i],"NIL is not a number"); \
+        if (real) { \
+            if (typeOf(argv[i]) == ID_REAL) { \
+                accum_r = accum_r op asREAL(argv[i]); \
+            } else { \
+                accum_r = accum_r op asINTEGER(argv[i]); \
+            } \
+        } else { \
+            if (typeOf(argv[i]) == ID_REAL) { \
+                real = true; \
+                accum_r = accum_i op asREAL(argv[i]); \
+            } else { \
+                accum_i = accum_i op asINTEGER(argv[i]); \
+            } \
+        } \
+    } \
     return real ? asVALUE(newREAL(accum_r)) : asVALUE(newINTEGER(accum_i));
+
+VALUE* l_add(int argc, VALUE **argv, NODE *scope) {
+    arith_fold("+",+,false,0)
 }
 
-VALUE* l_mul(NODE *args, NODE *scope) {
-    debugVal(args,"mul: ");
-    bool real = false;
-    T_REAL accum_r = 1.0;
-    T_INTEGER accum_i = 1;
-    while (args) {
-        failNIL(args->data,"NIL is not a number");
-        if (real) {
-            if (args->data->type == ID_REAL) {
-                accum_r *= ((REAL*)args->data)->val;
-            } else {
-                accum_r *= asINTEGER(args->data)->val;
-            }
-        } else {
-            if (args->data->type == ID_REAL) {
-                real = true;
-                accum_r = accum_i * ((REAL*)args->data)->val;
-            } else {
-                accum_i *= asINTEGER(args->data)->val;
-            }
-        }
-        args = asNODE(args->addr);
-    }    
-    return real ? asVALUE(newREAL(accum_r)) : asVALUE(newINTEGER(accum_i));
+VALUE* l_mul(int argc, VALUE **argv, NODE *scope) {
+    arith_fold("*",*,false,1)
 }
 
-VALUE* l_sub(NODE *args, NODE *scope) {
-    debugVal(args,"sub: ");
-    bool real = false;
-    T_REAL accum_r;
-    T_INTEGER accum_i;
-    failNIL(args->data,"NIL is not a number");
-    if (args->data->type == ID_REAL) {
-        accum_r = ((REAL*)args->data)->val;
-        real = true;
-    } else {
-        accum_i = asINTEGER(args->data)->val;
+VALUE* l_sub(int argc, VALUE **argv, NODE *scope) {
+    arith_fold("-",-,true,0)
+}
+
+VALUE* l_div(int argc, VALUE **argv, NODE *scope) {
+    arith_fold("/",/,true,1)
+}
+
+//numeric comparison, true if op holds between each pair of neighbours
+#define compare_chain(name,op) \
+    if (!argc) error(name" takes at least 1 argument"); \
+    for (int i = 1; i < argc; i++) { \
+        VALUE *a = argv[i-1], *b = argv[i]; \
+        failNIL(a && b,"NIL is not a number"); \
+        if (typeOf(a) == ID_INTEGER && typeOf(b) == ID_INTEGER) { \
+            if (!(asINTEGER(a) op asINTEGER(b))) return NIL; \
+        } else { \
+            if (!(asNUMBER(a) op asNUMBER(b))) return NIL; \
+        } \
+    } \
+    return l_true();
+
+//the one T every true result shares, so tests allocate nothing
+static VALUE *true_value = NIL;
+
+static inline VALUE* l_true() {
+    if (!true_value) {
+        true_value = (VALUE*)newSYMBOL(intern("T"));
+        true_value->flags |= FLAG_CONST;
+        gc_root(&true_value);
     }
-    args = asNODE(args->addr);
-    while (args) {
-        failNIL(args->data,"NIL is not a number");
-        if (real) {
-            if (args->data->type == ID_REAL) {
-                accum_r -= ((REAL*)args->data)->val;
-            } else {
-                accum_r -= asINTEGER(args->data)->val;
-            }
-        } else {
-            if (args->data->type == ID_REAL) {
-                real = true;
-                accum_r = accum_i - ((REAL*)args->data)->val;
-            } else {
-                accum_i -= asINTEGER(args->data)->val;
-            }
-        }
-        args = asNODE(args->addr);
-    }    
-    return real ? asVALUE(newREAL(accum_r)) : asVALUE(newINTEGER(accum_i));
+    incRef(true_value);
+    return true_value;
 }
 
-VALUE* l_div(NODE *args, NODE *scope) {
-    debugVal(args,"div: ");
-    bool real = false;
-    T_REAL accum_r;
-    T_INTEGER accum_i;
-    failNIL(args->data,"NIL is not a number");
-    if (args->data->type == ID_REAL) {
-        accum_r = ((REAL*)args->data)->val;
-        real = true;
-    } else {
-        accum_i = asINTEGER(args->data)->val;
+VALUE* l_lt(int argc, VALUE **argv, NODE *scope) {
+    compare_chain("<",<)
+}
+
+VALUE* l_gt(int argc, VALUE **argv, NODE *scope) {
+    compare_chain(">",>)
+}
+
+VALUE* l_eq(int argc, VALUE **argv, NODE *scope) {
+    compare_chain("=",==)
+}
+
+VALUE* l_le(int argc, VALUE **argv, NODE *scope) {
+    compare_chain("<=",<=)
+}
+
+VALUE* l_ge(int argc, VALUE **argv, NODE *scope) {
+    compare_chain(">=",>=)
+}
+
+//two-operand kernels, installed by resolve at call sites with two arguments:
+//fixnums and reals go straight through, anything else to the generic primitive
+#define binary_kernel(name,generic,int_res,real_res) \
+    VALUE* name(int argc, VALUE **argv, NODE *scope) { \
+        if (argc != 2) return generic(argc,argv,scope); \
+        VALUE *a = argv[0], *b = argv[1]; \
+        if (isFIXNUM(a) && isFIXNUM(b)) { \
+            T_INTEGER x = asINTEGER(a), y = asINTEGER(b); \
+            return int_res; \
+        } \
+        if (a && b && typeOf(a) == ID_REAL && typeOf(b) == ID_REAL) { \
+            T_REAL x = asREAL(a), y = asREAL(b); \
+            return real_res; \
+        } \
+        return generic(argc,argv,scope); \
     }
-    args = asNODE(args->addr);
-    while (args) {
-        failNIL(args->data,"NIL is not a number");
-        if (real) {
-            if (args->data->type == ID_REAL) {
-                accum_r /= ((REAL*)args->data)->val;
-            } else {
-                accum_r /= asINTEGER(args->data)->val;
-            }
-        } else {
-            if (args->data->type == ID_REAL) {
-                real = true;
-                accum_r = accum_i / ((REAL*)args->data)->val;
-            } else {
-                accum_i /= asINTEGER(args->data)->val;
-            }
-        }
-        args = asNODE(args->addr);
-    }    
-    return real ? asVALUE(newREAL(accum_r)) : asVALUE(newINTEGER(accum_i));
+
+binary_kernel(l_add2,l_add,newINTEGER(x + y),newREAL(x + y))
+binary_kernel(l_sub2,l_sub,newINTEGER(x - y),newREAL(x - y))
+binary_kernel(l_mul2,l_mul,newINTEGER(x * y),newREAL(x * y))
+binary_kernel(l_div2,l_div,newINTEGER(x / y),newREAL(x / y))
+binary_kernel(l_lt2,l_lt,x < y ? l_true() : NIL,x < y ? l_true() : NIL)
+binary_kernel(l_gt2,l_gt,x > y ? l_true() : NIL,x > y ? l_true() : NIL)
+binary_kernel(l_eq2,l_eq,x == y ? l_true() : NIL,x == y ? l_true() : NIL)
+binary_kernel(l_le2,l_le,x <= y ? l_true() : NIL,x <= y ? l_true() : NIL)
+binary_kernel(l_ge2,l_ge,x >= y ? l_true() : NIL,x >= y ? l_true() : NIL)
+
+static const struct {
+    ARGV_FUNC generic, binary;
+} binary_kernels[] = {
+    { l_add, l_add2 }, { l_sub, l_sub2 }, { l_mul, l_mul2 }, { l_div, l_div2 },
+    { l_lt, l_lt2 }, { l_gt, l_gt2 }, { l_eq, l_eq2 }, { l_le, l_le2 }, { l_ge, l_ge2 }
+};
+
+//returns the two-operand kernel of prim, or NIL if it has none
+PRIMFUNC* prim_binary(PRIMFUNC *prim) {
+    if (prim->abi != ABI_ARGV) return NIL;
+    for (size_t i = 0; i < sizeof(binary_kernels)/sizeof(binary_kernels[0]); i++) {
+        if (prim->native == (NATIVE_FUNC)binary_kernels[i].generic) return newPRIMFUNC(SPEC_FUNC,ABI_ARGV,(NATIVE_FUNC)binary_kernels[i].binary);
+    }
+    return NIL;
 }
 
+//returns the generic primitive of a two-operand kernel, or NIL if prim is not one
+PRIMFUNC* prim_generic(PRIMFUNC *prim) {
+    if (prim->abi != ABI_ARGV) return NIL;
+    for (size_t i = 0; i < sizeof(binary_kernels)/sizeof(binary_kernels[0]); i++) {
+        if (prim->native == (NATIVE_FUNC)binary_kernels[i].binary) return newPRIMFUNC(SPEC_FUNC,ABI_ARGV,(NATIVE_FUNC)binary_kernels[i].generic);
+    }
+    return NIL;
+}
 
-VALUE* l_print(NODE *args, NODE *scope) {
-    if (!args) {
+VALUE* l_print(int argc, VALUE **argv, NODE *scope) {
+    if (!argc) {
         print(NIL);
         return NIL;
     }
-    while (args->addr) {
-        print(args->data);
-        args = asNODE(args->addr);
-    }
-    print(args->data);
+    for (int i = 0; i < argc; i++) print(argv[i]);
     printf("\n");
-    incRef(args->data);
-    return args->data;
+    incRef(argv[argc-1]);
+    return argv[argc-1];
+}
+
+VALUE* l_isnode(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 1) error("ISNODE takes exactly 1 argument");
+    return argv[0] && typeOf(argv[0]) == ID_NODE ? l_true() : NIL;
+}
+
+VALUE* l_vector(int argc, VALUE **argv, NODE *scope) {
+    return (VALUE*)vec_fromValues(argv,argc);
+}
+
+VALUE* l_makevector(int argc, VALUE **argv, NODE *scope) {
+    if (argc < 1 || argc > 2) error("MAKE-VECTOR takes 1 or 2 arguments");
+    T_INTEGER len = asINTEGER(argv[0]);
+    if (len < 0) error("MAKE-VECTOR of negative length");
+    VECTOR *vec = newVECTOR(argc == 2 && argv[1] && typeOf(argv[1]) == ID_REAL ? VEC_REAL : VEC_INTEGER,len);
+    if (argc == 2) {
+        for (T_INTEGER i = 0; i < len; i++) vec_set(vec,i,argv[1]);
+    }
+    return (VALUE*)vec;
+}
+
+VALUE* l_listvector(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 1) error("LIST-VECTOR takes exactly 1 argument");
+    return (VALUE*)vec_fromList(asNODE(argv[0]));
+}
+
+VALUE* l_vectorlist(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 1) error("VECTOR-LIST takes exactly 1 argument");
+    return (VALUE*)vec_toList(asVECTOR(argv[0]));
+}
+
+VALUE* l_vlen(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 1) error("VLEN takes exactly 1 argument");
+    return newINTEGER(asVECTOR(argv[0])->len);
+}
+
+VALUE* l_vref(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 2) error("VREF takes exactly 2 arguments");
+    return vec_ref(asVECTOR(argv[0]),asINTEGER(argv[1]));
+}
+
+VALUE* l_vset(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 3) error("VSET takes exactly 3 arguments");
+    VECTOR *vec = asVECTOR(argv[0]);
+    if (isCONST(vec)) error("VSET cannot modify a quoted constant");
+    vec_set(vec,asINTEGER(argv[1]),argv[2]);
+    incRef(argv[2]);
+    return argv[2];
+}
+
+#define vector_arith(name,op) \
+    if (argc != 2) error(name" takes exactly 2 arguments"); \
+    return (VALUE*)vec_arith(op,asVECTOR(argv[0]),argv[1]);
+
+VALUE* l_vadd(int argc, VALUE **argv, NODE *scope) {
+    vector_arith("V+",VEC_ADD)
+}
+
+VALUE* l_vsub(int argc, VALUE **argv, NODE *scope) {
+    vector_arith("V-",VEC_SUB)
+}
+
+VALUE* l_vmul(int argc, VALUE **argv, NODE *scope) {
+    vector_arith("V*",VEC_MUL)
+}
+
+VALUE* l_vdiv(int argc, VALUE **argv, NODE *scope) {
+    vector_arith("V/",VEC_DIV)
+}
+
+VALUE* l_vdot(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 2) error("VDOT takes exactly 2 arguments");
+    return vec_dot(asVECTOR(argv[0]),asVECTOR(argv[1]));
+}
+
+#define vector_reduce(name,op) \
+    if (argc != 1) error(name" takes exactly 1 argument"); \
+    return vec_reduce(op,asVECTOR(argv[0]));
+
+VALUE* l_vsum(int argc, VALUE **argv, NODE *scope) {
+    vector_reduce("VSUM",VEC_SUM)
+}
+
+VALUE* l_vmin(int argc, VALUE **argv, NODE *scope) {
+    vector_reduce("VMIN",VEC_MIN)
+}
+
+VALUE* l_vmax(int argc, VALUE **argv, NODE *scope) {
+    vector_reduce("VMAX",VEC_MAX)
+}
+
+VALUE* l_makearray(int argc, VALUE **argv, NODE *scope) {
+    if (argc < 1 || argc > 2) error("MAKE-ARRAY takes 1 or 2 arguments");
+    T_INTEGER len = asINTEGER(argv[0]);
+    if (len < 0) error("MAKE-ARRAY of negative length");
+    ARRAY *arr = newARRAY(len);
+    if (argc == 2) {
+        for (T_INTEGER i = 0; i < len; i++) {
+            incRef(argv[1]);
+            arr->items[i] = argv[1];
+        }
+    }
+    return (VALUE*)arr;
+}
+
+static size_t array_index(ARRAY *arr, VALUE *index) {
+    T_INTEGER i = asINTEGER(index);
+    if (i < 0 || (size_t)i >= arr->len) error("Index %i out of bounds for an ARRAY of %u",i,(unsigned int)arr->len);
+    return (size_t)i;
+}
+
+VALUE* l_aref(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 2) error("AREF takes exactly 2 arguments");
+    ARRAY *arr = asARRAY(argv[0]);
+    VALUE *res = arr->items[array_index(arr,argv[1])];
+    incRef(res);
+    return res;
+}
+
+VALUE* l_aset(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 3) error("ASET takes exactly 3 arguments");
+    ARRAY *arr = asARRAY(argv[0]);
+    if (isCONST(arr)) error("ASET cannot modify a quoted constant");
+    VALUE **item = &arr->items[array_index(arr,argv[1])];
+    decRef(*item);
+    incRef(argv[2]);
+    incRef(argv[2]);
+    *item = argv[2];
+    return argv[2];
+}
+
+//returns the array, so pushes chain
+VALUE* l_push(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 2) error("PUSH takes exactly 2 arguments");
+    ARRAY *arr = asARRAY(argv[0]);
+    if (isCONST(arr)) error("PUSH cannot modify a quoted constant");
+    incRef(argv[1]);
+    array_push(arr,argv[1]);
+    incRef(arr);
+    return (VALUE*)arr;
+}
+
+//O(1) but for lists
+VALUE* l_length(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 1) error("LENGTH takes exactly 1 argument");
+    VALUE *val = argv[0];
+    if (!val) return newINTEGER(0);
+    switch (typeOf(val)) {
+        case ID_NODE:
+            return newINTEGER(list_length((NODE*)val));
+        case ID_ARRAY:
+            return newINTEGER(((ARRAY*)val)->len);
+        case ID_VECTOR:
+            return newINTEGER(((VECTOR*)val)->len);
+        case ID_STRING:
+            return newINTEGER(strlen(((STRING*)val)->str));
+    }
+    error("LENGTH of a value that is not a sequence");
+}
+
+VALUE* l_makehash(int argc, VALUE **argv, NODE *scope) {
+    if (argc > 1) error("MAKE-HASH takes at most 1 argument");
+    T_INTEGER size = argc ? asINTEGER(argv[0]) : 0;
+    if (size < 0) error("MAKE-HASH of negative size");
+    return (VALUE*)newHASH(size);
+}
+
+//(gethash key table [default])
+VALUE* l_gethash(int argc, VALUE **argv, NODE *scope) {
+    if (argc < 2 || argc > 3) error("GETHASH takes 2 or 3 arguments");
+    bool found;
+    VALUE *res = hash_get(asHASH(argv[1]),argv[0],&found);
+    if (!found) res = argc == 3 ? argv[2] : NIL;
+    incRef(res);
+    return res;
+}
+
+//(puthash key val table)
+VALUE* l_puthash(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 3) error("PUTHASH takes exactly 3 arguments");
+    HASH *hash = asHASH(argv[2]);
+    if (isCONST(hash)) error("PUTHASH cannot modify a quoted constant");
+    hash_put(hash,argv[0],argv[1]);
+    incRef(argv[1]);
+    return argv[1];
+}
+
+//(remhash key table) is true if key was there
+VALUE* l_remhash(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 2) error("REMHASH takes exactly 2 arguments");
+    HASH *hash = asHASH(argv[1]);
+    if (isCONST(hash)) error("REMHASH cannot modify a quoted constant");
+    return hash_remove(hash,argv[0]) ? l_true() : NIL;
+}
+
+VALUE* l_hashcount(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 1) error("HASH-COUNT takes exactly 1 argument");
+    return newINTEGER(asHASH(argv[0])->count);
+}
+
+VALUE* l_hashpairs(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 1) error("HASH-PAIRS takes exactly 1 argument");
+    return (VALUE*)hash_pairs(asHASH(argv[0]));
+}
+
+VALUE* l_hcons(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 2) error("HCONS takes exactly 2 arguments");
+    return (VALUE*)hash_cons(hash_share(argv[0]),hash_share(argv[1]));
+}
+
+VALUE* l_share(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 1) error("SHARE takes exactly 1 argument");
+    return hash_share(argv[0]);
+}
+
+VALUE* l_hash(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 1) error("HASH takes exactly 1 argument");
+    return newINTEGER((T_INTEGER)hashVALUE(argv[0]));
+}
+
+VALUE* l_equal(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 2) error("EQUAL takes exactly 2 arguments");
+    return equalVALUE(argv[0],argv[1]) ? l_true() : NIL;
+}
+
+static size_t memo_limit(VALUE *val) {
+    if (!val) return 0;
+    T_INTEGER limit = asINTEGER(val);
+    if (limit < 0) error("Negative MEMO limit");
+    return limit;
+}
+
+//(memoize func [limit]) where a NIL limit is unbounded
+VALUE* l_memoize(int argc, VALUE **argv, NODE *scope) {
+    if (argc < 1 || argc > 2) error("MEMOIZE takes 1 or 2 arguments");
+    VALUE *func = argv[0];
+    failNIL(func,"MEMOIZE of NIL");
+    if (typeOf(func) == ID_PRIMFUNC ? ((PRIMFUNC*)func)->spec != SPEC_FUNC : typeOf(func) != ID_NODE && typeOf(func) != ID_MEMO) error("MEMOIZE of a value that is not a function");
+    return (VALUE*)newMEMO(func,argc == 2 ? memo_limit(argv[1]) : MEMO_LIMIT);
+}
+
+//( hits misses evictions count limit )
+VALUE* l_memostats(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 1) error("MEMO-STATS takes exactly 1 argument");
+    MEMO *memo = asMEMO(argv[0]);
+    size_t stats[] = { memo->hits, memo->misses, memo->evictions, memo->count, memo->limit };
+    NODE *list = NIL;
+    for (int i = sizeof(stats)/sizeof(stats[0]); i--; ) list = newNODE(newINTEGER(stats[i]),list);
+    return (VALUE*)list;
+}
+
+//(memo-forget memo arg ...) is true if a result for those arguments was cached
+VALUE* l_memoforget(int argc, VALUE **argv, NODE *scope) {
+    if (argc < 1) error("MEMO-FORGET takes at least 1 argument");
+    return memo_forget(asMEMO(argv[0]),argc-1,argv+1) ? l_true() : NIL;
+}
+
+VALUE* l_memoclear(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 1) error("MEMO-CLEAR takes exactly 1 argument");
+    memo_clear(asMEMO(argv[0]));
+    return NIL;
+}
+
+//(memo-limit memo limit) evicts down to the new limit at once
+VALUE* l_memolimit(int argc, VALUE **argv, NODE *scope) {
+    if (argc != 2) error("MEMO-LIMIT takes exactly 2 arguments");
+    memo_setLimit(asMEMO(argv[0]),memo_limit(argv[1]));
+    incRef(argv[1]);
+    return argv[1];
+}
+
+VALUE* l_memstats(NODE *args, NODE *scope) {
+    if (args) error("MEMSTATS takes no arguments");
+    return (VALUE*)newNODE(newINTEGER(alloc_live()),newNODE(newINTEGER(alloc_total()),NIL));
+}
+
+VALUE* l_gc(NODE *args, NODE *scope) {
+    if (args) error("GC takes no arguments");
+    return newINTEGER(gc_collect());
 }
 
-VALUE* l_isnode(NODE *args, NODE *scope) {
-    if (!args || args->addr) error("ISNODE takes exactly 1 argument");
-    return args->data->type == ID_NODE ? (VALUE*)newSYMBOL(intern("T")) : NIL;
+//( collections heap-slabs trigger-slabs last-pause-us max-pause-us total-pause-us )
+VALUE* l_gcstats(NODE *args, NODE *scope) {
+    if (args) error("GCSTATS takes no arguments");
+    NODE *stats = NIL;
+    list_push(newINTEGER(gc_stats.total_pause),&stats);
+    list_push(newINTEGER(gc_stats.max_pause),&stats);
+    list_push(newINTEGER(gc_stats.last_pause),&stats);
+    list_push(newINTEGER(alloc_trigger),&stats);
+    list_push(newINTEGER(alloc_slabs),&stats);
+    list_push(newINTEGER(gc_stats.collections),&stats);
+    return (VALUE*)stats;
 }
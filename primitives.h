@@ -28,24 +28,93 @@ VALUE* l_lambda(NODE *args, NODE *scope);
 VALUE* l_prog(NODE *args, NODE *scope);
 VALUE* l_cond(NODE *args, NODE *scope);
 
+//the loops run their bodies through eval, so each engine can drive them
+typedef VALUE* (*EVAL_FUNC)(VALUE *form, NODE *scope);
+VALUE* l_while(NODE *args, NODE *scope);
+VALUE* l_dotimes(NODE *args, NODE *scope);
+VALUE* l_dolist(NODE *args, NODE *scope);
+bool loop_run(PRIMFUNC *prim, NODE *args, NODE *scope, EVAL_FUNC eval, VALUE **res);
+
 NODE* l_list(NODE *args, NODE *scope);
 VALUE* l_quote(NODE *args, NODE *scope);
-VALUE* l_node(NODE *args, NODE *scope);
-VALUE* l_data(NODE *args, NODE *scope);
-VALUE* l_addr(NODE *args, NODE *scope);
-VALUE* l_seta(NODE *args, NODE *scope);
-VALUE* l_setd(NODE *args, NODE *scope);
+VALUE* l_node(int argc, VALUE **argv, NODE *scope);
+VALUE* l_data(int argc, VALUE **argv, NODE *scope);
+VALUE* l_addr(int argc, VALUE **argv, NODE *scope);
+VALUE* l_seta(int argc, VALUE **argv, NODE *scope);
+VALUE* l_setd(int argc, VALUE **argv, NODE *scope);
+
+VALUE* l_add(int argc, VALUE **argv, NODE *scope);
+VALUE* l_mul(int argc, VALUE **argv, NODE *scope);
+VALUE* l_sub(int argc, VALUE **argv, NODE *scope);
+VALUE* l_div(int argc, VALUE **argv, NODE *scope);
+
+VALUE* l_lt(int argc, VALUE **argv, NODE *scope);
+VALUE* l_gt(int argc, VALUE **argv, NODE *scope);
+VALUE* l_eq(int argc, VALUE **argv, NODE *scope);
+VALUE* l_le(int argc, VALUE **argv, NODE *scope);
+VALUE* l_ge(int argc, VALUE **argv, NODE *scope);
+
+VALUE* l_add2(int argc, VALUE **argv, NODE *scope);
+VALUE* l_sub2(int argc, VALUE **argv, NODE *scope);
+VALUE* l_mul2(int argc, VALUE **argv, NODE *scope);
+VALUE* l_div2(int argc, VALUE **argv, NODE *scope);
+VALUE* l_lt2(int argc, VALUE **argv, NODE *scope);
+VALUE* l_gt2(int argc, VALUE **argv, NODE *scope);
+VALUE* l_eq2(int argc, VALUE **argv, NODE *scope);
+VALUE* l_le2(int argc, VALUE **argv, NODE *scope);
+VALUE* l_ge2(int argc, VALUE **argv, NODE *scope);
+PRIMFUNC* prim_binary(PRIMFUNC *prim);
+PRIMFUNC* prim_generic(PRIMFUNC *prim);
+
+VALUE* l_ref(int argc, VALUE **argv, NODE *scope);
+VALUE* l_bind(int argc, VALUE **argv, NODE *scope);
+
+VALUE* l_vector(int argc, VALUE **argv, NODE *scope);
+VALUE* l_makevector(int argc, VALUE **argv, NODE *scope);
+VALUE* l_listvector(int argc, VALUE **argv, NODE *scope);
+VALUE* l_vectorlist(int argc, VALUE **argv, NODE *scope);
+VALUE* l_vlen(int argc, VALUE **argv, NODE *scope);
+VALUE* l_vref(int argc, VALUE **argv, NODE *scope);
+VALUE* l_vset(int argc, VALUE **argv, NODE *scope);
+VALUE* l_vadd(int argc, VALUE **argv, NODE *scope);
+VALUE* l_vsub(int argc, VALUE **argv, NODE *scope);
+VALUE* l_vmul(int argc, VALUE **argv, NODE *scope);
+VALUE* l_vdiv(int argc, VALUE **argv, NODE *scope);
+VALUE* l_vdot(int argc, VALUE **argv, NODE *scope);
+VALUE* l_vsum(int argc, VALUE **argv, NODE *scope);
+VALUE* l_vmin(int argc, VALUE **argv, NODE *scope);
+VALUE* l_vmax(int argc, VALUE **argv, NODE *scope);
+
+VALUE* l_makearray(int argc, VALUE **argv, NODE *scope);
+VALUE* l_aref(int argc, VALUE **argv, NODE *scope);
+VALUE* l_aset(int argc, VALUE **argv, NODE *scope);
+VALUE* l_push(int argc, VALUE **argv, NODE *scope);
+VALUE* l_length(int argc, VALUE **argv, NODE *scope);
+
+VALUE* l_makehash(int argc, VALUE **argv, NODE *scope);
+VALUE* l_gethash(int argc, VALUE **argv, NODE *scope);
+VALUE* l_puthash(int argc, VALUE **argv, NODE *scope);
+VALUE* l_remhash(int argc, VALUE **argv, NODE *scope);
+VALUE* l_hashcount(int argc, VALUE **argv, NODE *scope);
+VALUE* l_hashpairs(int argc, VALUE **argv, NODE *scope);
+
+VALUE* l_hcons(int argc, VALUE **argv, NODE *scope);
+VALUE* l_share(int argc, VALUE **argv, NODE *scope);
+VALUE* l_hash(int argc, VALUE **argv, NODE *scope);
+VALUE* l_equal(int argc, VALUE **argv, NODE *scope);
 
-VALUE* l_add(NODE *args, NODE *scope);
-VALUE* l_mul(NODE *args, NODE *scope);
-VALUE* l_sub(NODE *args, NODE *scope);
-VALUE* l_div(NODE *args, NODE *scope);
+VALUE* l_memoize(int argc, VALUE **argv, NODE *scope);
+VALUE* l_memostats(int argc, VALUE **argv, NODE *scope);
+VALUE* l_memoforget(int argc, VALUE **argv, NODE *scope);
+VALUE* l_memoclear(int argc, VALUE **argv, NODE *scope);
+VALUE* l_memolimit(int argc, VALUE **argv, NODE *scope);
 
-VALUE* l_ref(NODE *args, NODE *scope);
-VALUE* l_bind(NODE *args, NODE *scope);
+VALUE* l_print(int argc, VALUE **argv, NODE *scope);
 
-VALUE* l_print(NODE *args, NODE *scope);
+VALUE* l_isnode(int argc, VALUE **argv, NODE *scope);
 
-VALUE* l_isnode(NODE *args, NODE *scope);
+VALUE* l_memstats(NODE *args, NODE *scope);
+VALUE* l_gc(NODE *args, NODE *scope);
+VALUE* l_gcstats(NODE *args, NODE *scope);
 
 #endif 
@@ -0,0 +1,294 @@
+/**
+ *  Copyright 2013 by Benjamin J. Land (a.k.a. BenLand100)
+ *
+ *  This file is part of L, a virtual machine for a lisp-like language.
+ *
+ *  L is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  L is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with L. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "resolve.h"
+#include "primitives.h"
+#include "parser.h"
+#include "scope.h"
+#include "listops.h"
+
+//one LAMBDA's argument list on the C stack while its body is walked
+typedef struct LEXICAL {
+    NODE *vars;
+    bool dynamic; //calls BIND: references from inside stay symbols
+    bool refs; //calls REF, nested LAMBDAs included: captured arguments are boxed
+    ARGSPEC *closed; //set if the LAMBDA is closure converted
+    struct LEXICAL *parent;
+} LEXICAL;
+
+static bool resolve_init_flag = false;
+static T_SYMBOL sym_rest;
+static T_SYMBOL sym_optional;
+
+//same convention as call_function: ((a b)) binds the unevaluated arguments
+static NODE* lambda_vars(VALUE *vars) {
+    vars = lambda_written(vars);
+    if (!vars || typeOf(vars) != ID_NODE) return NIL;
+    NODE *list = (NODE*)vars;
+    if (!list->addr && list->data && typeOf(list->data) == ID_NODE) return (NODE*)list->data;
+    return list;
+}
+
+//slot numbering matches scope_bindArgs: markers take no slot
+static int lambda_slot(NODE *vars, T_SYMBOL sym) {
+    int slot = 0;
+    for (; vars && typeOf(vars) == ID_NODE; vars = (NODE*)vars->addr) {
+        if (!vars->data || typeOf(vars->data) != ID_SYMBOL) continue;
+        T_SYMBOL var = ((SYMBOL*)vars->data)->sym;
+        if (var == sym_rest || var == sym_optional) continue;
+        if (var == sym) return slot;
+        slot++;
+    }
+    return -1;
+}
+
+//does this body call BIND outside of QUOTE and nested LAMBDAs
+bool resolve_binds(VALUE *val) {
+    if (!val || typeOf(val) != ID_NODE) return false;
+    VALUE *head = ((NODE*)val)->data;
+    if (head && typeOf(head) == ID_PRIMFUNC) {
+        PRIMFUNC *prim = (PRIMFUNC*)head;
+        if (prim->native == (NATIVE_FUNC)l_bind) return true;
+        if (prim->spec == SPEC_QUOTE || prim->spec == SPEC_LAMBDA) return false;
+    }
+    for (; val && typeOf(val) == ID_NODE; val = ((NODE*)val)->addr) {
+        if (resolve_binds(((NODE*)val)->data)) return true;
+    }
+    return false;
+}
+
+//does val call native anywhere outside of QUOTE, nested LAMBDAs included; an
+//unexpanded body might
+static bool resolve_calls(VALUE *val, NATIVE_FUNC native) {
+    if (!val || typeOf(val) != ID_NODE) return false;
+    VALUE *head = ((NODE*)val)->data;
+    if (head && typeOf(head) == ID_PRIMFUNC) {
+        PRIMFUNC *prim = (PRIMFUNC*)head;
+        if (prim->native == native) return true;
+        if (prim->spec == SPEC_QUOTE) return false;
+        if (prim->spec == SPEC_LAMBDA) {
+            VALUE *lambda = ((NODE*)val)->addr;
+            if (lambda && typeOf(lambda) == ID_NODE && (lambda->flags & FLAG_LAZY)) return true;
+        }
+    }
+    for (; val && typeOf(val) == ID_NODE; val = ((NODE*)val)->addr) {
+        if (resolve_calls(((NODE*)val)->data,native)) return true;
+    }
+    return false;
+}
+
+//a LAMBDA can drop its enclosing frames if nothing inside it looks variables
+//up by name and nothing outside it can BIND new names into those frames
+static bool lambda_closable(VALUE *body, LEXICAL *env) {
+    for (; env; env = env->parent) {
+        if (env->dynamic) return false;
+    }
+    return !resolve_calls(body,(NATIVE_FUNC)l_bind) && !resolve_calls(body,(NATIVE_FUNC)l_ref);
+}
+
+//where sym lives at runtime as seen from env, counting frames up from env's
+static bool resolve_lookup(T_SYMBOL sym, LEXICAL *env, int *depth, int *slot, LEXICAL **owner) {
+    if (!env) return false;
+    int found = lambda_slot(env->vars,sym);
+    if (found >= 0) {
+        *depth = 0;
+        *slot = found;
+        *owner = env;
+        return true;
+    }
+    if (env->dynamic || !resolve_lookup(sym,env->parent,depth,slot,owner)) return false;
+    if (env->closed) {
+        *slot = scope_addCapture(env->closed,sym,*depth,*slot,(*owner)->refs);
+        *depth = 1;
+    } else {
+        (*depth)++;
+    }
+    return true;
+}
+
+static VALUE* resolve_symbol(SYMBOL *sym, LEXICAL *env) {
+    int depth, slot;
+    LEXICAL *owner;
+    if (!resolve_lookup(sym->sym,env,&depth,&slot,&owner)) return NIL;
+    return (VALUE*)newLOCAL(sym->sym,depth,slot);
+}
+
+static void resolve_form(NODE *form, LEXICAL *env);
+
+//constant code a macro spliced in is shared, so its symbols stay symbols, but
+//any closure converted LAMBDA around it must still capture what they name
+static void resolve_free(VALUE *val, LEXICAL *env) {
+    if (!env || !val || isIMMEDIATE(val)) return;
+    if (val->type == ID_SYMBOL) {
+        int depth, slot;
+        LEXICAL *owner;
+        resolve_lookup(((SYMBOL*)val)->sym,env,&depth,&slot,&owner);
+        return;
+    }
+    if (val->type != ID_NODE) return;
+    VALUE *head = ((NODE*)val)->data;
+    if (head && typeOf(head) == ID_PRIMFUNC && ((PRIMFUNC*)head)->spec == SPEC_QUOTE) return;
+    for (; val && typeOf(val) == ID_NODE; val = ((NODE*)val)->addr) resolve_free(((NODE*)val)->data,env);
+}
+
+static void resolve_value(VALUE **ref, LEXICAL *env) {
+    VALUE *val = *ref;
+    if (!val || isIMMEDIATE(val)) return;
+    switch (val->type) {
+        case ID_SYMBOL: {
+            VALUE *local = resolve_symbol((SYMBOL*)val,env);
+            if (local) {
+                decRef(val);
+                *ref = local;
+            }
+            return;
+        }
+        case ID_NODE:
+            resolve_form((NODE*)val,env);
+            return;
+    }
+}
+
+//each element of list is evaluated
+static void resolve_list(VALUE *list, LEXICAL *env) {
+    for (; list && typeOf(list) == ID_NODE && !isCONST(list); list = ((NODE*)list)->addr) {
+        resolve_value(&((NODE*)list)->data,env);
+    }
+    for (; list && typeOf(list) == ID_NODE; list = ((NODE*)list)->addr) resolve_free(((NODE*)list)->data,env);
+}
+
+//a DOTIMES or DOLIST frame sits between its body and env; its value is
+//evaluated outside of it. BIND passes through the frame, so it never hides
+//anything, and the variable is updated in place, so closures that capture it
+//share its box like REF would
+static void resolve_loop(NODE *form, LEXICAL *env) {
+    NODE *args = asNODE(form->addr);
+    NODE *header = asNODE(args ? args->data : NIL);
+    if (list_length(header) != 2) error("Malformed loop header");
+    resolve_list(header->addr,env);
+    LEXICAL lex = { lambda_vars((VALUE*)scope_loopArgs(header)), false, true, NIL, env };
+    resolve_list(args->addr,&lex);
+}
+
+static void resolve_form(NODE *form, LEXICAL *env) {
+    if (form->datatype != DATA_NODE) return;
+    if (isCONST(form)) {
+        resolve_free((VALUE*)form,env);
+        return;
+    }
+    if (form->data && typeOf(form->data) == ID_PRIMFUNC) {
+        PRIMFUNC *prim = (PRIMFUNC*)form->data;
+        switch (prim->spec) {
+            case SPEC_QUOTE:
+            case SPEC_MACRODEF:
+                return;
+            case SPEC_LAMBDA: {
+                NODE *lambda = (NODE*)form->addr;
+                if (!lambda || typeOf(lambda) != ID_NODE || (lambda->flags & FLAG_LAZY)) return;
+                LEXICAL lex = { lambda_vars(lambda->data), resolve_binds(lambda->addr), resolve_calls(lambda->addr,(NATIVE_FUNC)l_ref), NIL, env };
+                if (lambda_closable(lambda->addr,env)) {
+                    lex.closed = scope_argspec(lambda);
+                    lex.closed->closed = true;
+                }
+                resolve_list(lambda->addr,&lex);
+                return;
+            }
+            case SPEC_MACRO:
+                if (prim->native == (NATIVE_FUNC)l_cond) {
+                    for (VALUE *clause = form->addr; clause && typeOf(clause) == ID_NODE; clause = ((NODE*)clause)->addr) {
+                        VALUE *test = ((NODE*)clause)->data;
+                        if (test && typeOf(test) == ID_NODE) resolve_list(test,env);
+                    }
+                    return;
+                }
+                if (prim->native == (NATIVE_FUNC)l_dotimes || prim->native == (NATIVE_FUNC)l_dolist) {
+                    resolve_loop(form,env);
+                    return;
+                }
+                break;
+            case SPEC_FUNC: {
+                NODE *args = (NODE*)form->addr;
+                if (!args || !args->addr || typeOf(args->addr) != ID_NODE || ((NODE*)args->addr)->addr) break;
+                PRIMFUNC *binary = prim_binary(prim);
+                if (binary) {
+                    decRef(prim);
+                    form->data = (VALUE*)binary;
+                }
+                break;
+            }
+        }
+    } else {
+        resolve_value(&form->data,env);
+    }
+    resolve_list(form->addr,env);
+}
+
+static void resolve_init() {
+    if (!resolve_init_flag) {
+        resolve_init_flag = true;
+        sym_rest = intern("&REST");
+        sym_optional = intern("&OPTIONAL");
+    }
+}
+
+VALUE* resolve(VALUE *form) {
+    resolve_init();
+    if (form && typeOf(form) == ID_NODE) resolve_form((NODE*)form,NIL);
+    return form;
+}
+
+//as resolve, for code that runs below frames it cannot see, such as a lazily
+//expanded LAMBDA body: nothing in it is closure converted
+VALUE* resolve_nested(VALUE *form) {
+    resolve_init();
+    LEXICAL unknown = { NIL, true, true, NIL, NIL };
+    if (form && typeOf(form) == ID_NODE) resolve_form((NODE*)form,&unknown);
+    return form;
+}
+
+//returns a new reference to form with every LOCAL turned back into its SYMBOL
+//and every two-operand kernel into its generic primitive, copying only if form
+//contains one
+VALUE* resolve_strip(VALUE *form) {
+    if (!form || isIMMEDIATE(form)) return form;
+    switch (form->type) {
+        case ID_LOCAL:
+            return (VALUE*)newSYMBOL(((LOCAL*)form)->sym);
+        case ID_PRIMFUNC: {
+            PRIMFUNC *generic = prim_generic((PRIMFUNC*)form);
+            if (generic) return (VALUE*)generic;
+            break;
+        }
+        case ID_NODE: {
+            VALUE *data = resolve_strip(((NODE*)form)->data);
+            VALUE *addr = resolve_strip(((NODE*)form)->addr);
+            if (data == ((NODE*)form)->data && addr == ((NODE*)form)->addr) {
+                decRef(data);
+                decRef(addr);
+                incRef(form);
+                return form;
+            }
+            NODE *copy = newNODE(data,addr);
+            copy->datatype = ((NODE*)form)->datatype;
+            return (VALUE*)copy;
+        }
+    }
+    incRef(form);
+    return form;
+}
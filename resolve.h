@@ -0,0 +1,45 @@
+/**
+ *  Copyright 2013 by Benjamin J. Land (a.k.a. BenLand100)
+ *
+ *  This file is part of L, a virtual machine for a lisp-like language.
+ *
+ *  L is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  L is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with L. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RESOLVE
+#define _RESOLVE
+
+#include "lisp.h"
+
+//lexical addressing pass, run on macroexpanded code: symbols that name an
+//argument of an enclosing LAMBDA are rewritten in place to LOCAL (depth, slot)
+//refs. a reference is left as a symbol (resolved through the scope chain at
+//runtime) if it is global or would cross a LAMBDA whose body calls BIND,
+//since that BIND could shadow it at runtime. a LAMBDA that neither calls REF or
+//BIND nor sits inside one that BINDs is closure converted: references to
+//enclosing arguments become captures (see ARGSPEC) and closures keep only those.
+//constant code a macro splices in is shared and left as written, but whatever
+//its symbols name is still captured.
+//the variable of a DOTIMES or DOLIST is addressed like an argument of a LAMBDA
+//wrapping the loop body.
+//calls of arithmetic and comparison primitives with two arguments are pointed
+//at their two-operand kernels; resolve_strip, which hands quoted arguments over
+//as written, points them back at the generic primitives.
+
+VALUE* resolve(VALUE *form);
+VALUE* resolve_nested(VALUE *form);
+VALUE* resolve_strip(VALUE *form);
+bool resolve_binds(VALUE *body);
+
+#endif
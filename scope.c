@@ -20,10 +20,81 @@
 #include "scope.h"
 #include "binmap.h"
 #include "parser.h"
+#include "listops.h"
+
+static bool scope_init_syms_flag = false;
+static T_SYMBOL sym_rest;
+static T_SYMBOL sym_optional;
+void scope_init_syms() {
+    scope_init_syms_flag = true;
+    sym_rest = intern("&REST");
+    sym_optional = intern("&OPTIONAL");
+}
 
 NODE* scope_push(NODE *parent_scope) {
+    return scope_pushFrame(parent_scope,NIL);
+}
+
+//compiles the lambda list of a (vars . body) and puts the ARGSPEC in its place
+ARGSPEC* scope_compileArgs(NODE *lambda) {
+    if (!scope_init_syms_flag) scope_init_syms();
+    NODE *vars = asNODE(lambda->data);
+    ARGSPEC *spec = (ARGSPEC*)alloc_VALUE(ID_ARGSPEC,sizeof(ARGSPEC));
+    spec->type = ID_ARGSPEC;
+    spec->flags = 0;
+    spec->refc = 1;
+    spec->vars = (VALUE*)vars; //the reference moves from lambda
+    spec->size = spec->required = spec->optional = 0;
+    spec->rest = false;
+    spec->mode = ARGS_EVAL;
+    spec->closed = false;
+    spec->loop = false;
+    spec->ncaptures = 0;
+    spec->captures = NIL;
+    spec->env = NIL;
+    if (vars && !vars->addr && vars->data && typeOf(vars->data) == ID_NODE) {
+        spec->mode = ARGS_QUOTED;
+        vars = (NODE*)vars->data;
+    }
+    spec->syms = (T_SYMBOL*)malloc((list_length(vars)+1)*sizeof(T_SYMBOL));
+    failNIL(spec->syms,"Out of memory");
+    bool optional = false;
+    for (; vars; vars = asNODE(vars->addr)) {
+        T_SYMBOL sym = asSYMBOL(vars->data)->sym;
+        if (sym == sym_rest) {
+            vars = asNODE(vars->addr);
+            if (!vars || vars->addr) error("&REST argument must be last");
+            spec->syms[spec->size++] = asSYMBOL(vars->data)->sym;
+            spec->rest = true;
+            break;
+        } else if (sym == sym_optional) {
+            optional = true;
+            continue;
+        }
+        spec->syms[spec->size++] = sym;
+        if (optional) spec->optional++; else spec->required++;
+    }
+    lambda->data = (VALUE*)spec;
+    return spec;
+}
+
+//the one-slot ARGSPEC of a loop's (var value) header, compiled the first time
+//it is needed and put in place of var; returned without a new reference
+ARGSPEC* scope_loopArgs(NODE *header) {
+    VALUE *var = header->data;
+    if (var && !isIMMEDIATE(var) && var->type == ID_ARGSPEC) return (ARGSPEC*)var;
+    asSYMBOL(var);
+    header->data = (VALUE*)newNODE(var,NIL); //the reference to var moves into the list
+    ARGSPEC *spec = scope_compileArgs(header);
+    spec->loop = true;
+    return spec;
+}
+
+//a scope with a slot for each variable of spec
+NODE* scope_pushFrame(NODE *parent_scope, ARGSPEC *spec) {
     incRef(parent_scope);
-    NODE *scope = newNODE(NIL,parent_scope);
+    incRef(spec);
+    NODE *scope = newNODE(newFRAME(spec,spec ? spec->size : 0),parent_scope);
     scope->datatype = DATA_SCOPE;
     return scope;
 }
@@ -34,11 +105,93 @@ NODE* scope_pop(NODE *scope) {
     return parent_scope;
 }
 
+//slot numbering matches resolve: markers take no slot
+static int scope_slot(FRAME *frame, T_SYMBOL sym) {
+    ARGSPEC *spec = frame->spec;
+    if (!spec) return -1;
+    for (int slot = 0; slot < spec->size; slot++) {
+        if (spec->syms[slot] == sym) return slot;
+    }
+    return -1;
+}
+
+//moves a slot's value into a (sym . val) entry that can be handed out; slots
+//past FRAME_BOXBITS are boxed when filled
+static NODE* scope_box(FRAME *frame, int slot, T_SYMBOL sym) {
+    if (!frame_boxed(frame,slot)) {
+        frame->slots[slot] = (VALUE*)newNODE(newSYMBOL(sym),frame->slots[slot]);
+        frame->boxed |= (uint64_t)1 << slot;
+    }
+    return (NODE*)frame->slots[slot];
+}
+
+//records that closures of spec capture sym from (depth, slot) of the scope they
+//are created in; returns its slot in their captured frame
+int scope_addCapture(ARGSPEC *spec, T_SYMBOL sym, int depth, int slot, bool box) {
+    for (int i = 0; i < spec->ncaptures; i++) {
+        if (spec->captures[i].sym == sym) return i;
+    }
+    spec->captures = (CAPTURE*)realloc(spec->captures,(spec->ncaptures+1)*sizeof(CAPTURE));
+    failNIL(spec->captures,"Out of memory");
+    CAPTURE *capture = &spec->captures[spec->ncaptures];
+    capture->depth = depth;
+    capture->slot = slot;
+    capture->sym = sym;
+    capture->box = box;
+    return spec->ncaptures++;
+}
+
+//the scope a closure of the closed spec keeps when created in scope
+NODE* scope_capture(ARGSPEC *spec, NODE *scope) {
+    NODE *root = scope;
+    while (root->addr) root = (NODE*)root->addr;
+    incRef(root);
+    if (!spec->ncaptures) return root;
+    if (!spec->env) {
+        ARGSPEC *env = (ARGSPEC*)alloc_VALUE(ID_ARGSPEC,sizeof(ARGSPEC));
+        memset(env,0,sizeof(ARGSPEC));
+        env->type = ID_ARGSPEC;
+        env->refc = 1;
+        env->size = env->required = spec->ncaptures;
+        env->syms = (T_SYMBOL*)malloc(spec->ncaptures*sizeof(T_SYMBOL));
+        failNIL(env->syms,"Out of memory");
+        for (int i = 0; i < spec->ncaptures; i++) env->syms[i] = spec->captures[i].sym;
+        spec->env = env;
+    }
+    incRef(spec->env);
+    FRAME *frame = newFRAME(spec->env,spec->ncaptures);
+    for (int i = 0; i < spec->ncaptures; i++) {
+        CAPTURE *capture = &spec->captures[i];
+        NODE *from = scope;
+        for (int depth = capture->depth; depth; depth--) from = (NODE*)from->addr;
+        FRAME *source = (FRAME*)from->data;
+        VALUE *val;
+        if (capture->box || frame_boxed(source,capture->slot) || i >= FRAME_BOXBITS) {
+            val = (VALUE*)scope_box(source,capture->slot,capture->sym);
+            if (i < FRAME_BOXBITS) frame->boxed |= (uint64_t)1 << i;
+        } else {
+            val = source->slots[capture->slot];
+        }
+        incRef(val);
+        frame->slots[i] = val;
+    }
+    NODE *captured = newNODE(frame,root);
+    captured->datatype = DATA_SCOPE;
+    return captured;
+}
+
 NODE* scope_ref(SYMBOL *sym, NODE *scope) {
     debug("resolving: %s\n", sym_str(sym));
     while (scope) {
         debugVal(scope,"scope: ");
-        NODE *entry = binmap_find(sym,(NODE*)scope->data);
+        FRAME *frame = (FRAME*)scope->data;
+        int slot = scope_slot(frame,sym->sym);
+        if (slot >= 0) {
+            NODE *entry = scope_box(frame,slot,sym->sym);
+            incRef(entry);
+            return entry;
+        }
+        NODE *entry = binmap_find(sym,frame->map);
         if (entry) return entry;
         scope = (NODE*)scope->addr;
     }
@@ -46,57 +199,85 @@ NODE* scope_ref(SYMBOL *sym, NODE *scope) {
 }
 
 VALUE* scope_resolve(SYMBOL *sym, NODE *scope) {
-    NODE *ref = scope_ref(sym,scope);
-    failNIL(ref,"Unbound symbol: %s", sym_str(sym));
-    VALUE *val = ref->addr;
-    incRef(val);
-    decRef(ref);
-    return val;
+    debug("resolving: %s\n", sym_str(sym));
+    for (; scope; scope = (NODE*)scope->addr) {
+        FRAME *frame = (FRAME*)scope->data;
+        int slot = scope_slot(frame,sym->sym);
+        VALUE *val;
+        if (slot >= 0) {
+            val = frame->slots[slot];
+            if (frame_boxed(frame,slot)) val = ((NODE*)val)->addr;
+        } else {
+            NODE *entry = binmap_find(sym,frame->map);
+            if (!entry) continue;
+            val = entry->addr;
+            decRef(entry); //still held by the map
+        }
+        incRef(val);
+        return val;
+    }
+    error("Unbound symbol: %s", sym_str(sym));
 }
 
+//rebinds an argument in its slot, anything else spills into the map of the
+//innermost frame that is not a loop's
 void scope_bind(SYMBOL *sym, VALUE *val, NODE *scope) {
     debugVal(val,"Binding %s => ", sym_str(sym));
     incRef(val);
+    FRAME *frame = (FRAME*)scope->data;
+    int slot = scope_slot(frame,sym->sym);
+    while (slot < 0 && frame->spec && frame->spec->loop) {
+        scope = (NODE*)scope->addr;
+        frame = (FRAME*)scope->data;
+        slot = scope_slot(frame,sym->sym);
+    }
+    if (slot >= 0) {
+        scope_setSlot(slot,val,scope);
+        return;
+    }
     incRef(sym);
-    if (scope->data) {
-        binmap_put(sym,val,(NODE*)scope->data);
+    if (frame->map) {
+        binmap_put(sym,val,frame->map);
     } else {
-        scope->data = (VALUE*)binmap(sym,val);
+        frame->map = binmap(sym,val);
     }
 }
 
-static bool scope_init_syms_flag = false;
-static T_SYMBOL sym_rest;
-static T_SYMBOL sym_optional;
-void scope_init_syms() {
-    scope_init_syms_flag = true;
-    sym_rest = intern("&REST");
-    sym_optional = intern("&OPTIONAL");
+//takes the reference to val
+static inline void scope_fill(FRAME *frame, int slot, T_SYMBOL sym, VALUE *val) {
+    if (slot >= FRAME_BOXBITS) val = (VALUE*)newNODE(newSYMBOL(sym),val);
+    frame->slots[slot] = val;
 }
 
-void scope_bindArgs(NODE *vars, NODE *vals, NODE *scope) {        
-    if (!scope_init_syms_flag) scope_init_syms();
-    bool optional = false;
-    while (vars) {
-        T_SYMBOL sym = asSYMBOL(vars->data)->sym;
-        if (sym == sym_rest) {
-            vars = asNODE(vars->addr);
-            if (vars->addr) error("&REST argument must be last");
-            incRef(vals);
-            scope_bind(asSYMBOL(vars->data),(VALUE*)vals,scope);
-            return;
-        } else if (sym == sym_optional) {
-            vars = asNODE(vars->addr);
-            optional = true;
-            scope_bind((SYMBOL*)vars->data,vals ? vals->data : NIL,scope);
-        } else if (optional) {
-            scope_bind((SYMBOL*)vars->data,vals ? vals->data : NIL,scope);
-        } else {
-            if (!vals) error("Not enough arguments to fill variables");
-            scope_bind((SYMBOL*)vars->data,vals->data,scope);
-        }
-        vars = asNODE(vars->addr);
-        if (vals) vals = asNODE(vals->addr);
+//fills the frame's slots straight from the argument list
+void scope_bindArgs(ARGSPEC *spec, NODE *vals, NODE *scope) {
+    FRAME *frame = (FRAME*)scope->data;
+    int fixed = spec->required + spec->optional, slot = 0;
+    for (; slot < fixed && vals; slot++, vals = asNODE(vals->addr)) {
+        incRef(vals->data);
+        scope_fill(frame,slot,spec->syms[slot],vals->data);
+    }
+    if (slot < spec->required) error("Not enough arguments to fill variables");
+    for (; slot < fixed; slot++) scope_fill(frame,slot,spec->syms[slot],NIL);
+    if (spec->rest) {
+        incRef(vals);
+        scope_fill(frame,slot,spec->syms[slot],(VALUE*)vals);
+    } else if (vals) {
+        error("Too many arguments to fill variables");
+    }
+}
+
+//as scope_bindArgs, but takes count values (and their references) from an array
+void scope_bindValues(ARGSPEC *spec, VALUE **vals, int count, NODE *scope) {
+    FRAME *frame = (FRAME*)scope->data;
+    int fixed = spec->required + spec->optional, slot = 0;
+    if (count < spec->required) error("Not enough arguments to fill variables");
+    if (count > fixed && !spec->rest) error("Too many arguments to fill variables");
+    for (; slot < count && slot < fixed; slot++) scope_fill(frame,slot,spec->syms[slot],vals[slot]);
+    for (; slot < fixed; slot++) scope_fill(frame,slot,spec->syms[slot],NIL);
+    if (spec->rest) {
+        NODE *rest = NIL;
+        while (count > fixed) rest = newNODE(vals[--count],rest);
+        scope_fill(frame,slot,spec->syms[slot],(VALUE*)rest);
     }
-    if (vals) error("Too many arguments to fill variables");
 }
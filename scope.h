@@ -22,14 +22,50 @@
 
 #include "lisp.h"
 
-// scope = (symtree . parent_scope)
+// scope = (frame . parent_scope)
 
 NODE* scope_push(NODE *parent_scope);
+ARGSPEC* scope_compileArgs(NODE *lambda);
+ARGSPEC* scope_loopArgs(NODE *header);
+NODE* scope_pushFrame(NODE *parent_scope, ARGSPEC *spec);
+int scope_addCapture(ARGSPEC *spec, T_SYMBOL sym, int depth, int slot, bool box);
+NODE* scope_capture(ARGSPEC *spec, NODE *scope);
 NODE* scope_pop(NODE *scope);
 
 NODE* scope_ref(SYMBOL *sym, NODE *scope);
 VALUE* scope_resolve(SYMBOL *sym, NODE *scope);
 void scope_bind(SYMBOL *sym, VALUE *val, NODE *scope);
-void scope_bindArgs(NODE *syms, NODE *vals, NODE *scope);
+void scope_bindArgs(ARGSPEC *spec, NODE *vals, NODE *scope);
+
+void scope_bindValues(ARGSPEC *spec, VALUE **vals, int count, NODE *scope);
+
+//the ARGSPEC of a (vars . body), compiled the first time it is needed;
+//returned without a new reference
+static inline ARGSPEC* scope_argspec(NODE *lambda) {
+    VALUE *vars = lambda->data;
+    if (vars && !isIMMEDIATE(vars) && vars->type == ID_ARGSPEC) return (ARGSPEC*)vars;
+    return scope_compileArgs(lambda);
+}
+
+static inline VALUE* scope_slotValue(unsigned int depth, unsigned int slot, NODE *scope) {
+    for (; depth; depth--) scope = (NODE*)scope->addr;
+    FRAME *frame = (FRAME*)scope->data;
+    VALUE *val = frame->slots[slot];
+    if (frame_boxed(frame,slot)) val = ((NODE*)val)->addr;
+    incRef(val);
+    return val;
+}
+
+//replaces a slot's value in place and takes the reference to val
+static inline void scope_setSlot(unsigned int slot, VALUE *val, NODE *scope) {
+    FRAME *frame = (FRAME*)scope->data;
+    VALUE **ref = frame_boxed(frame,slot) ? &((NODE*)frame->slots[slot])->addr : &frame->slots[slot];
+    decRef(*ref);
+    *ref = val;
+}
+
+static inline VALUE* scope_local(LOCAL *local, NODE *scope) {
+    return scope_slotValue(local->depth,local->slot,scope);
+}
 
 #endif
@@ -22,21 +22,95 @@
 #include "parser.h"
 #include "listops.h"
 #include "binmap.h"
+#include "gc.h"
+#include "resolve.h"
+#include "optimize.h"
+#include "bytecode.h"
+#include "machine.h"
+#include "primitives.h"
+
+//picked per file by --tree (default), --vm or --stack
+#define ENGINE_TREE     0
+#define ENGINE_VM       1
+#define ENGINE_STACK    2
+static int engine = ENGINE_TREE;
+
+//--no-opt skips the optimize pass, --dump-opt prints each file's forms around it
+static bool opt_enabled = true;
+static bool opt_dump = false;
+
+static NODE *static_scope = NIL;
+static NODE *macro_map = NIL;
+
+//--lazy: a LAMBDA body goes through the passes below on its first call
+static void expand_lambda(NODE *lambda) {
+    macroexpand_lambda(lambda,static_scope,macro_map);
+    incRef(lambda);
+    NODE *form = newNODE(newPRIMFUNC(SPEC_LAMBDA,ABI_LIST,(NATIVE_FUNC)l_lambda),lambda);
+    debugVal(form,"lazy expansion: ");
+    if (opt_enabled) form = (NODE*)optimize((VALUE*)form);
+    resolve_nested((VALUE*)form);
+    if (engine == ENGINE_VM) compile_body(lambda);
+    decRef(form);
+}
 
 VALUE* eval_string(char *prog_str, NODE *static_scope, NODE *macro_map) {
     NODE *prog = parseForms(prog_str);
     debugVal(prog,"before macroexpand: ");
     prog = (NODE*)macroexpand(prog,static_scope,macro_map);
     debugVal(prog,"after macroexpand: ");
-    VALUE *val = evaluate((VALUE*)prog,static_scope);
+    if (opt_dump) {
+        printf("before optimize: ");
+        print((VALUE*)prog);
+        printf("\n");
+    }
+    if (opt_enabled) prog = (NODE*)optimize((VALUE*)prog);
+    if (opt_dump) {
+        printf("after optimize: ");
+        print((VALUE*)prog);
+        printf("\n");
+    }
+    prog = (NODE*)resolve((VALUE*)prog);
+    debugVal(prog,"after resolve: ");
+    if (engine == ENGINE_VM) prog = (NODE*)compile((VALUE*)prog);
+    VALUE *val = engine == ENGINE_STACK ? machine_eval((VALUE*)prog,static_scope) : evaluate((VALUE*)prog,static_scope);
     decRef(prog);
     return val;
 } 
 
 int main(int argc, char **argv) {
-    NODE *static_scope = scope_push(NIL);
-    NODE *macro_map = binmap(newSYMBOL(intern("NIL")),NIL);
+    gc_init(&argc);
+    static_scope = scope_push(NIL);
+    macro_map = binmap(newSYMBOL(intern("NIL")),NIL);
+    lambda_expander = expand_lambda;
+    gc_root((VALUE**)&static_scope);
+    gc_root((VALUE**)&macro_map);
     for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i],"--tree")) {
+            engine = ENGINE_TREE;
+            continue;
+        } else if (!strcmp(argv[i],"--vm")) {
+            engine = ENGINE_VM;
+            continue;
+        } else if (!strcmp(argv[i],"--stack")) {
+            engine = ENGINE_STACK;
+            continue;
+        } else if (!strcmp(argv[i],"--no-opt")) {
+            opt_enabled = false;
+            continue;
+        } else if (!strcmp(argv[i],"--dump-opt")) {
+            opt_dump = true;
+            continue;
+        } else if (!strcmp(argv[i],"--lazy")) {
+            macro_lazy = true;
+            continue;
+        } else if (!strcmp(argv[i],"--macro-cache")) {
+            macro_cache = true;
+            continue;
+        } else if (!strcmp(argv[i],"--stack-limit") && i+1 < argc) {
+            machine_limit = strtoul(argv[++i],NIL,10);
+            continue;
+        }
         debug("loading file: %s\n",argv[i]);
         FILE *f = fopen(argv[i],"rb");
         if (!f) error("Could not open file %s",argv[i]);
@@ -0,0 +1,259 @@
+/**
+ *  Copyright 2013 by Benjamin J. Land (a.k.a. BenLand100)
+ *
+ *  This file is part of L, a virtual machine for a lisp-like language.
+ *
+ *  L is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  L is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with L. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "vector.h"
+
+#if defined __GNUC__ && !defined NO_SIMD
+    #ifdef __AVX__
+        #define VEC_BYTES 32
+    #else
+        #define VEC_BYTES 16
+    #endif
+    #define VEC_ALIGN VEC_BYTES
+    typedef T_INTEGER VINT __attribute__((vector_size(VEC_BYTES)));
+    typedef T_REAL VREAL __attribute__((vector_size(VEC_BYTES)));
+
+    #define lanes(T,V) (sizeof(V)/sizeof(T))
+
+    //dst = a op b over whole vectors of lanes, leaving i at the remainder
+    #define simd_map(T,V,op) { \
+        if (scalar) { \
+            V s = (V){0} + *b; \
+            for (; i + lanes(T,V) <= n; i += lanes(T,V)) *(V*)(dst+i) = *(const V*)(a+i) op s; \
+        } else { \
+            for (; i + lanes(T,V) <= n; i += lanes(T,V)) *(V*)(dst+i) = *(const V*)(a+i) op *(const V*)(b+i); \
+        } \
+    }
+
+    #define simd_sum(T,V) { \
+        V acc = (V){0}; \
+        if (b) { \
+            for (; i + lanes(T,V) <= n; i += lanes(T,V)) acc += *(const V*)(a+i) * *(const V*)(b+i); \
+        } else { \
+            for (; i + lanes(T,V) <= n; i += lanes(T,V)) acc += *(const V*)(a+i); \
+        } \
+        for (size_t l = 0; l < lanes(T,V); l++) sum += acc[l]; \
+    }
+
+    //keeps the best of each lane, selecting through the comparison mask
+    #define simd_best(T,V,cmp) if (n >= lanes(T,V)) { \
+        V acc = *(const V*)a; \
+        for (i = lanes(T,V); i + lanes(T,V) <= n; i += lanes(T,V)) { \
+            V x = *(const V*)(a+i); \
+            __typeof__(x cmp acc) take = x cmp acc; \
+            acc = (V)(((__typeof__(take))x & take) | ((__typeof__(take))acc & ~take)); \
+        } \
+        for (size_t l = 0; l < lanes(T,V); l++) if (acc[l] cmp best) best = acc[l]; \
+    }
+#else
+    #define VEC_ALIGN sizeof(T_REAL)
+    #define simd_map(T,V,op) { }
+    #define simd_sum(T,V) { }
+    #define simd_best(T,V,cmp) { }
+#endif
+
+#define map_loop(T,V,op) { \
+    simd_map(T,V,op) \
+    for (; i < n; i++) dst[i] = a[i] op b[scalar ? 0 : i]; \
+}
+
+//dst = a op b elementwise, or a op b[0] throughout if scalar
+#define map_kernel(name,T,V) \
+static void name(int op, T *dst, const T *a, const T *b, bool scalar, size_t n) { \
+    size_t i = 0; \
+    switch (op) { \
+        case VEC_ADD: map_loop(T,V,+) break; \
+        case VEC_SUB: map_loop(T,V,-) break; \
+        case VEC_MUL: map_loop(T,V,*) break; \
+        case VEC_DIV: map_loop(T,V,/) break; \
+    } \
+}
+
+//the sum of a, or of a times b if b is given
+#define sum_kernel(name,T,V) \
+static T name(const T *a, const T *b, size_t n) { \
+    size_t i = 0; \
+    T sum = 0; \
+    simd_sum(T,V) \
+    for (; i < n; i++) sum += b ? a[i]*b[i] : a[i]; \
+    return sum; \
+}
+
+//the element of a non-empty a that wins every cmp
+#define best_kernel(name,T,V,cmp) \
+static T name(const T *a, size_t n) { \
+    size_t i = 1; \
+    T best = a[0]; \
+    simd_best(T,V,cmp) \
+    for (; i < n; i++) if (a[i] cmp best) best = a[i]; \
+    return best; \
+}
+
+map_kernel(map_ints,T_INTEGER,VINT)
+map_kernel(map_reals,T_REAL,VREAL)
+sum_kernel(sum_ints,T_INTEGER,VINT)
+sum_kernel(sum_reals,T_REAL,VREAL)
+best_kernel(min_ints,T_INTEGER,VINT,<)
+best_kernel(min_reals,T_REAL,VREAL,<)
+best_kernel(max_ints,T_INTEGER,VINT,>)
+best_kernel(max_reals,T_REAL,VREAL,>)
+
+#define elem_size(elem) ((elem) == VEC_REAL ? sizeof(T_REAL) : sizeof(T_INTEGER))
+
+//zero filled
+VECTOR* newVECTOR(T_TYPE elem, size_t len) {
+    size_t bytes = (len*elem_size(elem) + VEC_ALIGN - 1) & ~(size_t)(VEC_ALIGN - 1);
+    void *data;
+    if (posix_memalign(&data,VEC_ALIGN,bytes ? bytes : VEC_ALIGN)) error("Out of memory");
+    memset(data,0,bytes);
+    VECTOR *vec = (VECTOR*)alloc_VALUE(ID_VECTOR,sizeof(VECTOR));
+    vec->type = ID_VECTOR;
+    vec->flags = 0;
+    vec->refc = 1;
+    vec->elem = elem;
+    vec->len = len;
+    vec->data = data;
+    return vec;
+}
+
+//the element type that can hold val
+static T_TYPE vec_elemOf(VALUE *val) {
+    if (val) {
+        switch (typeOf(val)) {
+            case ID_INTEGER:
+                return VEC_INTEGER;
+            case ID_REAL:
+                return VEC_REAL;
+        }
+    }
+    error("VECTOR elements must be numbers");
+}
+
+static void vec_put(VECTOR *vec, size_t i, VALUE *val) {
+    if (vec->elem == VEC_REAL) {
+        vec_reals(vec)[i] = asNUMBER(val);
+    } else {
+        vec_ints(vec)[i] = asINTEGER(val);
+    }
+}
+
+VECTOR* vec_fromValues(VALUE **vals, size_t len) {
+    T_TYPE elem = VEC_INTEGER;
+    for (size_t i = 0; i < len; i++) elem |= vec_elemOf(vals[i]);
+    VECTOR *vec = newVECTOR(elem,len);
+    for (size_t i = 0; i < len; i++) vec_put(vec,i,vals[i]);
+    return vec;
+}
+
+VECTOR* vec_fromList(NODE *list) {
+    T_TYPE elem = VEC_INTEGER;
+    size_t len = 0;
+    for (NODE *rest = list; rest; rest = asNODE(rest->addr), len++) elem |= vec_elemOf(rest->data);
+    VECTOR *vec = newVECTOR(elem,len);
+    for (size_t i = 0; list; list = (NODE*)list->addr, i++) vec_put(vec,i,list->data);
+    return vec;
+}
+
+NODE* vec_toList(VECTOR *vec) {
+    NODE *list = NIL;
+    for (size_t i = vec->len; i--; ) {
+        VALUE *val = vec->elem == VEC_REAL ? newREAL(vec_reals(vec)[i]) : newINTEGER(vec_ints(vec)[i]);
+        list = newNODE(val,list);
+    }
+    return list;
+}
+
+static size_t vec_index(VECTOR *vec, T_INTEGER i) {
+    if (i < 0 || (size_t)i >= vec->len) error("Index %i out of bounds for a VECTOR of %u",i,(unsigned int)vec->len);
+    return (size_t)i;
+}
+
+VALUE* vec_ref(VECTOR *vec, T_INTEGER i) {
+    size_t at = vec_index(vec,i);
+    return vec->elem == VEC_REAL ? newREAL(vec_reals(vec)[at]) : newINTEGER(vec_ints(vec)[at]);
+}
+
+void vec_set(VECTOR *vec, T_INTEGER i, VALUE *val) {
+    size_t at = vec_index(vec,i);
+    if (vec_elemOf(val) == VEC_REAL && vec->elem != VEC_REAL) error("REAL stored into an INTEGER VECTOR");
+    vec_put(vec,at,val);
+}
+
+//vec as REALs: a new reference to vec itself or to a converted copy
+static VECTOR* vec_real(VECTOR *vec) {
+    if (vec->elem == VEC_REAL) {
+        incRef(vec);
+        return vec;
+    }
+    VECTOR *real = newVECTOR(VEC_REAL,vec->len);
+    for (size_t i = 0; i < vec->len; i++) vec_reals(real)[i] = vec_ints(vec)[i];
+    return real;
+}
+
+//a op b elementwise, b a VECTOR of the same length or a number for every element
+VECTOR* vec_arith(int op, VECTOR *a, VALUE *b) {
+    failNIL(b,"NIL is not a number");
+    bool scalar = typeOf(b) != ID_VECTOR;
+    T_TYPE elem = a->elem | (scalar ? vec_elemOf(b) : ((VECTOR*)b)->elem);
+    if (!scalar && ((VECTOR*)b)->len != a->len) error("VECTOR lengths differ");
+    VECTOR *res = newVECTOR(elem,a->len);
+    if (elem == VEC_REAL) {
+        T_REAL s = scalar ? asNUMBER(b) : 0;
+        VECTOR *x = vec_real(a), *y = scalar ? NIL : vec_real((VECTOR*)b);
+        map_reals(op,vec_reals(res),vec_reals(x),scalar ? &s : vec_reals(y),scalar,a->len);
+        decRef(x);
+        decRef(y);
+    } else {
+        T_INTEGER s = scalar ? asINTEGER(b) : 0;
+        const T_INTEGER *y = scalar ? &s : vec_ints((VECTOR*)b);
+        if (op == VEC_DIV) {
+            for (size_t i = 0; i < (scalar ? 1 : a->len); i++) {
+                if (!y[i]) error("Division by zero");
+            }
+        }
+        map_ints(op,vec_ints(res),vec_ints(a),y,scalar,a->len);
+    }
+    return res;
+}
+
+VALUE* vec_reduce(int op, VECTOR *vec) {
+    if (op != VEC_SUM && !vec->len) error("Empty VECTOR has no %s",op == VEC_MIN ? "minimum" : "maximum");
+    if (vec->elem == VEC_REAL) {
+        switch (op) {
+            case VEC_MIN: return newREAL(min_reals(vec_reals(vec),vec->len));
+            case VEC_MAX: return newREAL(max_reals(vec_reals(vec),vec->len));
+            default: return newREAL(sum_reals(vec_reals(vec),NIL,vec->len));
+        }
+    }
+    switch (op) {
+        case VEC_MIN: return newINTEGER(min_ints(vec_ints(vec),vec->len));
+        case VEC_MAX: return newINTEGER(max_ints(vec_ints(vec),vec->len));
+        default: return newINTEGER(sum_ints(vec_ints(vec),NIL,vec->len));
+    }
+}
+
+VALUE* vec_dot(VECTOR *a, VECTOR *b) {
+    if (a->len != b->len) error("VECTOR lengths differ");
+    if (a->elem == VEC_INTEGER && b->elem == VEC_INTEGER) return newINTEGER(sum_ints(vec_ints(a),vec_ints(b),a->len));
+    VECTOR *x = vec_real(a), *y = vec_real(b);
+    VALUE *res = newREAL(sum_reals(vec_reals(x),vec_reals(y),a->len));
+    decRef(x);
+    decRef(y);
+    return res;
+}
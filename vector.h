@@ -0,0 +1,50 @@
+/**
+ *  Copyright 2013 by Benjamin J. Land (a.k.a. BenLand100)
+ *
+ *  This file is part of L, a virtual machine for a lisp-like language.
+ *
+ *  L is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  L is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with L. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _VECTOR
+#define _VECTOR
+
+#include "lisp.h"
+
+//unboxed numeric vectors. elementwise arithmetic and the reductions work on
+//16 bytes at a time (32 with AVX) through GCC vector types and finish the
+//remainder one element at a time; -DNO_SIMD builds only the scalar loops.
+//REAL sums add lanes separately, so they may round differently without SIMD. an INTEGER vector
+//combined with a REAL one or a REAL scalar gives a REAL vector.
+
+#define VEC_ADD         0
+#define VEC_SUB         1
+#define VEC_MUL         2
+#define VEC_DIV         3
+
+#define VEC_SUM         0
+#define VEC_MIN         1
+#define VEC_MAX         2
+
+VECTOR* newVECTOR(T_TYPE elem, size_t len);
+VECTOR* vec_fromValues(VALUE **vals, size_t len);
+VECTOR* vec_fromList(NODE *list);
+NODE* vec_toList(VECTOR *vec);
+VALUE* vec_ref(VECTOR *vec, T_INTEGER i);
+void vec_set(VECTOR *vec, T_INTEGER i, VALUE *val);
+VECTOR* vec_arith(int op, VECTOR *a, VALUE *b);
+VALUE* vec_reduce(int op, VECTOR *vec);
+VALUE* vec_dot(VECTOR *a, VECTOR *b);
+
+#endif
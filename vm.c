@@ -0,0 +1,273 @@
+/**
+ *  Copyright 2013 by Benjamin J. Land (a.k.a. BenLand100)
+ *
+ *  This file is part of L, a virtual machine for a lisp-like language.
+ *
+ *  L is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  L is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with L. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bytecode.h"
+#include "primitives.h"
+#include "scope.h"
+#include "gc.h"
+#include "memo.h"
+
+//would call_function hand func its arguments unevaluated
+static inline bool vm_rawArgs(VALUE *func) {
+    if (!func) return false;
+    switch (typeOf(func)) {
+        case ID_PRIMFUNC:
+            return ((PRIMFUNC*)func)->spec != SPEC_FUNC;
+        case ID_NODE: {
+            NODE *lambda = asNODE(((NODE*)func)->addr);
+            return lambda && scope_argspec(lambda)->mode == ARGS_QUOTED;
+        }
+    }
+    return false;
+}
+
+//takes the references to the n values
+static inline NODE* vm_list(VALUE **vals, int n) {
+    NODE *list = NIL;
+    while (n) list = newNODE(vals[--n],list);
+    return list;
+}
+
+//calls func on the n evaluated arguments at args, taking their references
+static VALUE* vm_call(VALUE *func, VALUE **args, int n, NODE *scope) {
+    failNIL(func,"NIL cannot be invoked");
+    switch (typeOf(func)) {
+        case ID_PRIMFUNC: {
+            VALUE *res = call_prim((PRIMFUNC*)func,n,args,scope);
+            while (n) decRef(args[--n]);
+            return res;
+        }
+        case ID_NODE: {
+            NODE *lambda = asNODE(((NODE*)func)->addr);
+            lambda_force(lambda);
+            ARGSPEC *spec = scope_argspec(lambda);
+            NODE *fn_scope = scope_pushFrame(asNODE(((NODE*)func)->data),spec);
+            scope_bindValues(spec,args,n,fn_scope);
+            VALUE *res = l_prog(asNODE(lambda->addr),fn_scope);
+            scope_pop(fn_scope);
+            return res;
+        }
+        case ID_MEMO: {
+            VALUE *res = memo_call((MEMO*)func,n,args,scope);
+            while (n) decRef(args[--n]);
+            return res;
+        }
+    }
+    error("Malfored function invoke");
+}
+
+//a compiled closure entered by OP_TAILCALL: its code, its new frame, and the
+//closure itself, which keeps the code alive
+typedef struct {
+    CODE *code;
+    NODE *scope;
+    VALUE *func;
+} TAIL;
+
+//the body of a closure, if it is just one CODE
+static inline CODE* vm_body(VALUE *func) {
+    if (!func || typeOf(func) != ID_NODE) return NIL;
+    lambda_force(asNODE(((NODE*)func)->addr));
+    NODE *body = asNODE(asNODE(((NODE*)func)->addr)->addr);
+    if (!body || body->addr || !body->data || typeOf(body->data) != ID_CODE) return NIL;
+    return (CODE*)body->data;
+}
+
+//runs code, unless it ends in a tail call to compiled code: then returns NIL
+//with that call set up in *tail
+static VALUE* vm_exec(CODE *code, NODE *scope, TAIL *tail) {
+    gc_poll();
+    VALUE *stack[code->depth ? code->depth : 1];
+    VALUE **sp = stack, **consts = code->consts;
+    int *pc = code->ops;
+    for (;;) {
+        switch (*pc++) {
+            case OP_NIL:
+                *sp++ = NIL;
+                break;
+            case OP_CONST:
+                *sp = consts[*pc++];
+                incRef(*sp);
+                sp++;
+                break;
+            case OP_GLOBAL:
+                *sp++ = scope_resolve((SYMBOL*)consts[*pc++],scope);
+                break;
+            case OP_LOCAL:
+                *sp++ = scope_slotValue(pc[0],pc[1],scope);
+                pc += 2;
+                break;
+            case OP_POP:
+                sp--;
+                decRef(*sp);
+                break;
+            case OP_JUMP: {
+                int off = *pc++;
+                pc += off;
+                break;
+            }
+            case OP_JUMPNIL: {
+                int off = *pc++;
+                VALUE *test = *--sp;
+                if (test) {
+                    decRef(test);
+                } else {
+                    pc += off;
+                }
+                break;
+            }
+            case OP_CLOSURE:
+                *sp++ = l_lambda((NODE*)consts[*pc++],scope);
+                break;
+            case OP_ARGS: {
+                NODE *args = (NODE*)consts[pc[0]];
+                int off = pc[1];
+                pc += 2;
+                if (vm_rawArgs(sp[-1])) {
+                    VALUE *func = sp[-1];
+                    sp[-1] = call_function(func,args,scope);
+                    decRef(func);
+                    pc += off;
+                }
+                break;
+            }
+            case OP_CALL: {
+                int n = *pc++;
+                sp -= n;
+                VALUE *func = sp[-1];
+                sp[-1] = vm_call(func,sp,n,scope);
+                decRef(func);
+                break;
+            }
+            case OP_CALLPRIM: {
+                PRIMFUNC *prim = (PRIMFUNC*)consts[*pc++];
+                int n = *pc++;
+                sp -= n;
+                VALUE *res = call_prim(prim,n,sp,scope);
+                for (int i = 0; i < n; i++) decRef(sp[i]);
+                *sp++ = res;
+                break;
+            }
+            case OP_LIST: {
+                int n = *pc++;
+                sp -= n;
+                *sp = (VALUE*)vm_list(sp,n);
+                sp++;
+                break;
+            }
+            case OP_EVAL:
+                *sp++ = evaluate(consts[*pc++],scope);
+                break;
+            case OP_TAILCALL: {
+                int n = *pc++;
+                sp -= n;
+                VALUE *func = sp[-1];
+                CODE *body = vm_body(func);
+                if (!body) {
+                    sp[-1] = vm_call(func,sp,n,scope);
+                    decRef(func);
+                    break;
+                }
+                NODE *lambda = (NODE*)((NODE*)func)->addr;
+                ARGSPEC *spec = scope_argspec(lambda);
+                tail->scope = scope_pushFrame(asNODE(((NODE*)func)->data),spec);
+                scope_bindValues(spec,sp,n,tail->scope);
+                tail->code = body;
+                tail->func = func;
+                for (sp--; sp > stack; ) decRef(*--sp);
+                return NIL;
+            }
+            case OP_ENTER:
+                scope = scope_pushFrame(scope,(ARGSPEC*)consts[*pc++]);
+                break;
+            case OP_LEAVE:
+                scope = scope_pop(scope);
+                break;
+            case OP_DOTIMES: {
+                int off = *pc++;
+                T_INTEGER i = asINTEGER(sp[-1]);
+                if (i < asINTEGER(sp[-2])) {
+                    scope_setSlot(0,sp[-1],scope);
+                    sp[-1] = newINTEGER(i+1);
+                } else {
+                    decRef(*--sp);
+                    decRef(*--sp);
+                    pc += off;
+                }
+                break;
+            }
+            case OP_DOLIST: {
+                int off = *pc++;
+                NODE *list = asNODE(sp[-1]);
+                if (list) {
+                    incRef(list->data);
+                    scope_setSlot(0,list->data,scope);
+                    incRef(list->addr);
+                    sp[-1] = list->addr;
+                    decRef(list);
+                } else {
+                    sp--;
+                    pc += off;
+                }
+                break;
+            }
+            case OP_RETURN:
+                return *--sp;
+            default:
+                error("Invalid opcode %i",pc[-1]);
+        }
+    }
+}
+
+//the CODE each vm_run is running. vm_exec only keeps its ops and consts, which
+//live outside the heap, so without this the tracing collector could free a
+//program nothing else refers to while it runs
+static CODE **running = NIL;
+static size_t running_len = 0, running_cap = 0, running_bytes = 0;
+
+static void running_push(CODE *code) {
+    if (running_len == running_cap) {
+        if (!running) gc_area((void**)&running,&running_bytes);
+        running_cap = running_cap ? running_cap*2 : 64;
+        running = (CODE**)realloc(running,running_cap*sizeof(CODE*));
+        failNIL(running,"Out of memory");
+    }
+    running[running_len++] = code;
+    running_bytes = running_len*sizeof(CODE*);
+}
+
+//tail calls loop here instead of nesting vm_exec
+VALUE* vm_run(CODE *code, NODE *scope) {
+    TAIL tail = { NIL, NIL, NIL };
+    NODE *frame = NIL;
+    VALUE *frame_func = NIL, *res;
+    running_push(code);
+    while (!(res = vm_exec(code,scope,&tail)) && tail.code) {
+        decRef(frame);
+        decRef(frame_func);
+        code = running[running_len-1] = tail.code;
+        frame = scope = tail.scope;
+        frame_func = tail.func;
+        tail.code = NIL;
+    }
+    running_bytes = --running_len*sizeof(CODE*);
+    decRef(frame);
+    decRef(frame_func);
+    return res;
+}